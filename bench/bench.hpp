@@ -0,0 +1,72 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Shared helpers for the benchmark drivers in this directory
+
+namespace bench {
+
+// Return the elapsed time of f() in nanoseconds, best of runs repetitions
+// so one noisy run does not skew the result
+template <typename F>
+double best_ns(int runs, F&& f) {
+	double best = 0;
+	for (int i = 0; i < runs; i++) {
+		auto start = std::chrono::steady_clock::now();
+		f();
+		auto stop = std::chrono::steady_clock::now();
+		double ns = std::chrono::duration<double, std::nano>(stop - start).count();
+		if (i == 0 || ns < best) {
+			best = ns;
+		}
+	}
+	return best;
+}
+
+// Small deterministic generator, so every run sees the same keys
+class rng {
+public:
+	explicit rng(uint64_t seed) : m_state(seed) {}
+	uint64_t next() {
+		uint64_t z = (m_state += 0x9E3779B97F4A7C15ull);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+	// Uniform in [0, bound)
+	uint64_t below(uint64_t bound) { return next() % bound; }
+	// Uniform in [0, 1)
+	double unit() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+private:
+	uint64_t m_state;
+};
+
+// count distinct random strings of the form "key-<hex>"
+inline std::vector<std::string> random_strings(size_t count, uint64_t seed) {
+	rng r(seed);
+	std::vector<std::string> keys;
+	keys.reserve(count);
+	char buffer[32];
+	for (size_t i = 0; i < count; i++) {
+		std::snprintf(buffer, sizeof(buffer), "key-%016llx", static_cast<unsigned long long>(r.next()));
+		keys.push_back(buffer);
+	}
+	return keys;
+}
+
+// Parse argv[index] as a count, or return fallback if it is absent
+inline size_t arg_count(int argc, char** argv, int index, size_t fallback) {
+	return argc > index ? std::strtoull(argv[index], nullptr, 10) : fallback;
+}
+
+// Keep the optimizer from discarding a computed value
+template <typename T>
+void keep(const T& value) {
+	asm volatile("" : : "g"(&value) : "memory");
+}
+
+}
@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "bench.hpp"
+#include "hash_map.hpp"
+#include "adaptive_hash_map.hpp"
+#include "concurrent_hash_map.hpp"
+#include "lockfree_hash_map.hpp"
+#include "concurrent_adaptive_hash_map.hpp"
+using namespace cs251;
+
+/*
+* Multi-threaded throughput of the concurrent maps, from 1 thread up to every
+* hardware thread. Each thread runs the same mix against a prefilled map:
+* peeks of random prefilled keys, plus inserts and extracts of keys from a
+* range of its own, so no operation fails. One global mutex around a
+* hash_map is the baseline the sharded maps replace.
+*
+* Usage: concurrent_throughput [max_threads] [ops_per_thread] [peek_percent]
+*        (default every hardware thread, 1000000, 90)
+*/
+
+// A hash_map behind one mutex, with the interface of the concurrent maps
+class global_lock_map {
+public:
+	void insert(long key, std::unique_ptr<long> value) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_map.insert(key, std::move(value));
+	}
+	long peek(long key) const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return *m_map.peek(key);
+	}
+	std::unique_ptr<long> extract(long key) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_map.extract(key);
+	}
+private:
+	mutable std::mutex m_mutex;
+	hash_map<long,long> m_map;
+};
+
+// The value extract handed back, by pointer or inline
+static long value_of(const std::unique_ptr<long>& value) { return *value; }
+static long value_of(long value) { return value; }
+
+// Thread counts to measure: powers of two up to maxThreads, then maxThreads
+static std::vector<size_t> thread_counts(size_t maxThreads) {
+	std::vector<size_t> counts;
+	for (size_t threads = 1; threads < maxThreads; threads *= 2) {
+		counts.push_back(threads);
+	}
+	counts.push_back(maxThreads);
+	return counts;
+}
+
+// Return the operations per second of threads threads running the mix on map
+template <typename Map>
+static double run(Map& map, size_t threads, size_t ops, size_t prefill, unsigned peekPercent) {
+	std::atomic<size_t> ready{0};
+	std::atomic<bool> go{false};
+	std::vector<std::thread> workers;
+	for (size_t t = 0; t < threads; t++) {
+		workers.emplace_back([&, t] {
+			bench::rng r(t + 1);
+			// Keys past the prefill, disjoint between threads
+			long nextKey = static_cast<long>(prefill + t * ops);
+			long oldestKey = nextKey;
+			long sum = 0;
+			ready++;
+			while (!go.load(std::memory_order_acquire)) {
+			}
+			for (size_t i = 0; i < ops; i++) {
+				unsigned roll = static_cast<unsigned>(r.below(100));
+				if (roll < peekPercent) {
+					sum += map.peek(static_cast<long>(r.below(prefill)));
+				} else if (roll % 2 == 0 || oldestKey == nextKey) {
+					map.insert(nextKey, std::make_unique<long>(nextKey));
+					nextKey++;
+				} else {
+					sum += value_of(map.extract(oldestKey));
+					oldestKey++;
+				}
+			}
+			// Leave the map as prefilled for the next run
+			while (oldestKey != nextKey) {
+				map.extract(oldestKey++);
+			}
+			bench::keep(sum);
+		});
+	}
+	while (ready.load() != threads) {
+		std::this_thread::yield();
+	}
+	auto start = std::chrono::steady_clock::now();
+	go.store(true, std::memory_order_release);
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+	auto stop = std::chrono::steady_clock::now();
+	double seconds = std::chrono::duration<double>(stop - start).count();
+	return threads * ops / seconds;
+}
+
+template <typename Map>
+static void row(const char* label, size_t maxThreads, size_t ops, size_t prefill, unsigned peekPercent) {
+	Map map;
+	for (size_t key = 0; key < prefill; key++) {
+		map.insert(static_cast<long>(key), std::make_unique<long>(key));
+	}
+	std::printf("%-28s", label);
+	for (size_t threads : thread_counts(maxThreads)) {
+		std::printf(" %8.2f", run(map, threads, ops, prefill, peekPercent) / 1e6);
+		std::fflush(stdout);
+	}
+	std::printf("\n");
+}
+
+int main(int argc, char** argv) {
+	const size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+	const size_t maxThreads = bench::arg_count(argc, argv, 1, hardware);
+	const size_t ops = bench::arg_count(argc, argv, 2, 1000000);
+	const unsigned peekPercent = static_cast<unsigned>(bench::arg_count(argc, argv, 3, 90));
+	const size_t prefill = 1 << 20;
+
+	std::printf("%zu prefilled keys, %zu ops per thread, %u%% peeks, Mops/s by thread count\n",
+			prefill, ops, peekPercent);
+	std::printf("%-28s", "map");
+	for (size_t threads : thread_counts(maxThreads)) {
+		std::printf(" %8zu", threads);
+	}
+	std::printf("\n");
+	row<global_lock_map>("mutex + hash_map", maxThreads, ops, prefill, peekPercent);
+	row<concurrent_hash_map<long,long>>("sharded hash_map", maxThreads, ops, prefill, peekPercent);
+	row<concurrent_hash_map<long,long,inline_hash_map<long,long>>>("sharded inline_hash_map",
+			maxThreads, ops, prefill, peekPercent);
+	row<concurrent_hash_map<long,long,adaptive_hash_map<long,long>>>("sharded adaptive_hash_map",
+			maxThreads, ops, prefill, peekPercent);
+	row<concurrent_hash_map<long,long,inline_adaptive_hash_map<long,long>>>("sharded inline_adaptive",
+			maxThreads, ops, prefill, peekPercent);
+	row<lockfree_hash_map<long,long>>("lockfree_hash_map", maxThreads, ops, prefill, peekPercent);
+	row<concurrent_adaptive_hash_map<long,long>>("striped adaptive_hash_map", maxThreads, ops, prefill, peekPercent);
+	return 0;
+}
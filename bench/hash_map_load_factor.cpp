@@ -0,0 +1,83 @@
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include "bench.hpp"
+#include "hash_map.hpp"
+using namespace cs251;
+
+/*
+* hash_map lookup cost across table sizes and load factors.
+* Each table is presized, so it sits at exactly the given load factor while
+* it is measured. With probing that stops at the first empty slot, the cost
+* per operation should depend on the load factor but not on the table size.
+*
+* Usage: hash_map_load_factor [max_log2_buckets]   (default 22)
+*/
+
+int main(int argc, char** argv) {
+	const size_t maxLog = bench::arg_count(argc, argv, 1, 22);
+	const float loadFactors[] = {0.25f, 0.5f, 0.75f, 0.875f};
+	const size_t lookups = 1 << 20;
+
+	std::printf("%-10s %-6s %10s %10s %10s\n", "buckets", "load", "hit ns", "miss ns", "churn ns");
+	for (size_t log = 12; log <= maxLog; log += 2) {
+		const size_t buckets = size_t(1) << log;
+		for (float load : loadFactors) {
+			const size_t count = static_cast<size_t>(load * buckets);
+			bench::rng r(log * 100 + static_cast<size_t>(load * 100));
+			std::vector<long> keys(count);
+			std::vector<long> misses(count);
+			for (size_t i = 0; i < count; i++) {
+				keys[i] = static_cast<long>(r.next() >> 1);
+				misses[i] = -static_cast<long>(r.next() >> 1) - 1;
+			}
+
+			hash_map<long,long> hm(buckets);
+			hm.min_load_factor(0.0f);
+			hm.max_load_factor(1.0f);
+			for (size_t i = 0; i < count; i++) {
+				try {
+					hm.insert(keys[i], std::make_unique<long>(i));
+				} catch (const duplicate_key&) {
+				}
+			}
+
+			std::vector<size_t> order(lookups);
+			for (size_t& index : order) {
+				index = r.below(count);
+			}
+
+			double hit = bench::best_ns(3, [&] {
+				long sum = 0;
+				for (size_t index : order) {
+					sum += *hm.peek(keys[index]);
+				}
+				bench::keep(sum);
+			}) / lookups;
+			// A miss probes to the end of a run, the worst case for a lookup
+			std::vector<long*> found(lookups);
+			std::vector<long> missKeys(lookups);
+			for (size_t i = 0; i < lookups; i++) {
+				missKeys[i] = misses[order[i]];
+			}
+			double miss = bench::best_ns(3, [&] {
+				hm.peek_batch(missKeys.begin(), missKeys.end(), found.begin());
+				bench::keep(found);
+			}) / lookups;
+			// Extract a key and put it back, keeping the load factor fixed
+			double churn = bench::best_ns(3, [&] {
+				for (size_t i = 0; i < lookups / 4; i++) {
+					long key = keys[order[i]];
+					hm.insert(key, hm.extract(key));
+				}
+			}) / (lookups / 4);
+			if (hm.bucket_count() != buckets) {
+				std::fprintf(stderr, "table resized during the run\n");
+				return 1;
+			}
+
+			std::printf("%-10zu %-6.3f %10.1f %10.1f %10.1f\n", buckets, load, hit, miss, churn);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "bench.hpp"
+#include "app.hpp"
+#include "hash_map.hpp"
+#include "adaptive_hash_map.hpp"
+using namespace cs251;
+
+/*
+* Collision quality of the default hasher, mixed_hash, against the raw
+* std::hash it finalizes, over the key distributions our tables see.
+* For each distribution it reports, with the keys placed in a power-of-two
+* table at load factor 0.5 by the low bits of their hash:
+*   used   - fraction of distinct home buckets, ideally 1 - e^-0.5 = 39%
+*            of the buckets, i.e. about 79% of the keys
+*   max    - the most keys sharing one home bucket
+*   hm ns  - insert + peek + extract per key through hash_map
+*   ahm ns - the same through adaptive_hash_map
+* Names are also hashed with the h1 ^ (h2 << 1) combine std::hash<name> used
+* before hash_combine; std::hash<name> itself is now hash_combine.
+*
+* Usage: hash_quality [keys]   (default 32768)
+*/
+
+// std::hash with no finalizer, the bucket hash before mixed_hash
+template <typename K>
+struct raw_hash {
+	size_t operator()(const K& key) const { return std::hash<K>{}(key); }
+};
+
+// The combine std::hash<name> used before hash_combine
+struct xor_shift_name_hash {
+	size_t operator()(const name& n) const {
+		size_t h1 = std::hash<std::string_view>{}(std::string_view(n.m_first));
+		size_t h2 = std::hash<std::string_view>{}(std::string_view(n.m_last));
+		return h1 ^ (h2 << 1);
+	}
+};
+
+// The value extract handed back, which the benchmark drops
+template <typename Holder>
+static void drop(Holder&& value) {
+	bench::keep(value);
+}
+
+template <typename Map, typename K>
+static double time_map(const std::vector<K>& keys) {
+	return bench::best_ns(3, [&] {
+		Map map;
+		for (const K& key : keys) {
+			map.insert(key, std::make_unique<int>(1));
+		}
+		long sum = 0;
+		for (const K& key : keys) {
+			sum += *map.peek(key);
+		}
+		bench::keep(sum);
+		for (const K& key : keys) {
+			drop(map.extract(key));
+		}
+	}) / keys.size();
+}
+
+template <typename Hash, typename K>
+static void report(const char* keysLabel, const char* hashLabel, const std::vector<K>& keys) {
+	size_t buckets = next_power_of_two(keys.size() * 2);
+	std::vector<unsigned> load(buckets);
+	Hash hasher;
+	for (const K& key : keys) {
+		load[hasher(key) & (buckets - 1)]++;
+	}
+	size_t used = static_cast<size_t>(std::count_if(load.begin(), load.end(), [](unsigned n) { return n != 0; }));
+	unsigned fullest = *std::max_element(load.begin(), load.end());
+	double hm = time_map<hash_map<K,int,Hash>>(keys);
+	double ahm = time_map<adaptive_hash_map<K,int,bottom_up_splay,Hash>>(keys);
+	std::printf("%-14s %-12s %7.1f%% %8u %10.0f %10.0f\n", keysLabel, hashLabel,
+			100.0 * used / keys.size(), fullest, hm, ahm);
+	std::fflush(stdout);
+}
+
+template <typename K>
+static void compare(const char* keysLabel, const std::vector<K>& keys) {
+	report<raw_hash<K>>(keysLabel, "std::hash", keys);
+	report<mixed_hash<K>>(keysLabel, "mixed_hash", keys);
+}
+
+int main(int argc, char** argv) {
+	const size_t count = bench::arg_count(argc, argv, 1, 32768);
+	bench::rng r(13);
+
+	std::vector<long> sequential(count);
+	std::vector<long> strided(count);
+	std::vector<long> random(count);
+	for (size_t i = 0; i < count; i++) {
+		sequential[i] = static_cast<long>(i);
+		strided[i] = static_cast<long>(i * 1024);
+		random[i] = static_cast<long>(r.next() >> 1);
+	}
+	std::vector<std::string> strings = bench::random_strings(count, 13);
+	// First and last names drawn from small pools, as in a directory
+	std::vector<name> names;
+	size_t pool = 1;
+	while (pool * pool < count) {
+		pool++;
+	}
+	for (size_t i = 0; i < pool && names.size() < count; i++) {
+		for (size_t j = 0; j < pool && names.size() < count; j++) {
+			names.emplace_back("first" + std::to_string(i), "last" + std::to_string(j));
+		}
+	}
+
+	std::printf("%zu keys, home buckets at load factor 0.5\n", count);
+	std::printf("%-14s %-12s %8s %8s %10s %10s\n", "keys", "hasher", "used", "max", "hm ns", "ahm ns");
+	compare("sequential", sequential);
+	compare("stride-1024", strided);
+	compare("random", random);
+	compare("strings", strings);
+	report<xor_shift_name_hash>("names", "h1^(h2<<1)", names);
+	compare("names", names);
+	return 0;
+}
@@ -0,0 +1,126 @@
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "bench.hpp"
+#include "app.hpp"
+#include "hash_map.hpp"
+#include "adaptive_hash_map.hpp"
+#include "seeded_hash.hpp"
+using namespace cs251;
+
+/*
+* Throughput cost of the flooding-resistant seeded_hash (SipHash-1-3)
+* against the default mixed_hash, and the cost of recovering from a flood.
+* The mixed workload inserts every key, then runs peeks and extract+insert
+* pairs over random keys, then extracts every key.
+* The flood uses a hasher that sends every key to hash 0 until it is
+* reseeded, as keys chosen against a known hash would, and reports how many
+* reseeds it took and how long the inserts ran.
+*
+* Usage: seeded_hash_cost [keys]   (default 65536)
+*/
+
+// Hash 0 for every key until reseeded, mixed_hash afterwards
+template <typename K>
+struct flood_hash {
+	size_t operator()(const K& key) const { return m_seeded ? mixed_hash<K>{}(key) : 0; }
+	void reseed() {
+		m_seeded = true;
+		reseeds++;
+	}
+	bool m_seeded = false;
+	static inline size_t reseeds = 0;
+};
+
+// The value extract handed back, as a pointer again
+static std::unique_ptr<int> as_pointer(std::unique_ptr<int> value) { return value; }
+
+template <typename Map, typename K>
+static double mixed_workload(const std::vector<K>& keys) {
+	bench::rng r(14);
+	std::vector<size_t> order(keys.size() * 2);
+	for (size_t& index : order) {
+		index = r.below(keys.size());
+	}
+	size_t ops = 0;
+	double ns = bench::best_ns(3, [&] {
+		Map map;
+		ops = 0;
+		for (const K& key : keys) {
+			map.insert(key, std::make_unique<int>(1));
+		}
+		long sum = 0;
+		for (size_t i = 0; i < order.size(); i++) {
+			const K& key = keys[order[i]];
+			if (i % 4 == 0) {
+				map.insert(key, as_pointer(map.extract(key)));
+				ops += 2;
+			} else {
+				sum += *map.peek(key);
+				ops++;
+			}
+		}
+		bench::keep(sum);
+		for (const K& key : keys) {
+			map.extract(key);
+		}
+		ops += 2 * keys.size();
+	});
+	return ns / ops;
+}
+
+template <typename K, template <typename, typename, typename> class Table>
+static void compare(const char* label, const std::vector<K>& keys) {
+	double fast = mixed_workload<Table<K,int,mixed_hash<K>>>(keys);
+	double seeded = mixed_workload<Table<K,int,seeded_hash<K>>>(keys);
+	std::printf("%-20s %10.0f %10.0f %9.0f%%\n", label, fast, seeded, 100.0 * (seeded - fast) / fast);
+	std::fflush(stdout);
+}
+
+template <typename K, typename V, typename Hash>
+using hash_map_of = hash_map<K,V,Hash>;
+template <typename K, typename V, typename Hash>
+using adaptive_hash_map_of = adaptive_hash_map<K,V,bottom_up_splay,Hash>;
+
+template <typename Map>
+static void flood(const char* label, size_t count) {
+	flood_hash<long>::reseeds = 0;
+	double ns = bench::best_ns(1, [&] {
+		Map map;
+		for (size_t i = 0; i < count; i++) {
+			map.insert(static_cast<long>(i), std::make_unique<int>(1));
+		}
+	});
+	std::printf("%-20s %10zu %10.2f\n", label, flood_hash<long>::reseeds, ns / 1e9);
+}
+
+int main(int argc, char** argv) {
+	const size_t count = bench::arg_count(argc, argv, 1, 65536);
+	bench::rng r(14);
+	std::vector<long> ints(count);
+	for (long& key : ints) {
+		key = static_cast<long>(r.next() >> 1);
+	}
+	std::vector<std::string> strings = bench::random_strings(count, 14);
+	std::vector<name> names;
+	for (size_t i = 0; i < count; i++) {
+		names.emplace_back("first" + std::to_string(r.below(4096)), "last" + std::to_string(i));
+	}
+
+	std::printf("%zu keys, mixed workload, ns per operation\n", count);
+	std::printf("%-20s %10s %10s %10s\n", "map", "mixed", "seeded", "cost");
+	compare<long, hash_map_of>("hash_map long", ints);
+	compare<std::string, hash_map_of>("hash_map string", strings);
+	compare<name, hash_map_of>("hash_map name", names);
+	compare<long, adaptive_hash_map_of>("adaptive long", ints);
+	compare<std::string, adaptive_hash_map_of>("adaptive string", strings);
+	compare<name, adaptive_hash_map_of>("adaptive name", names);
+
+	const size_t floodCount = 200000;
+	std::printf("\n%zu inserts, every key hashing to 0 until reseeded\n", floodCount);
+	std::printf("%-20s %10s %10s\n", "map", "reseeds", "seconds");
+	flood<hash_map<long,int,flood_hash<long>>>("hash_map", floodCount);
+	flood<adaptive_hash_map<long,int,bottom_up_splay,flood_hash<long>>>("adaptive_hash_map", floodCount);
+	return 0;
+}
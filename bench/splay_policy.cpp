@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <numeric>
+#include <vector>
+#include "bench.hpp"
+#include "splay_tree.hpp"
+using namespace cs251;
+
+/*
+* splay_tree peek cost per splay policy, on uniform and skewed access streams.
+* Keys are inserted in random order, then peeked in one of two streams:
+* uniform picks every key with equal probability, zipf picks the key of rank
+* r with probability proportional to 1/r, with ranks shuffled over the keys.
+*
+* Usage: splay_policy [keys] [peeks]   (default 1000000 4000000)
+*/
+
+// Draw ranks from a zipf(1) distribution over count ranks
+static std::vector<size_t> zipf_ranks(size_t count, size_t draws, bench::rng& r) {
+	std::vector<double> cdf(count);
+	double total = 0;
+	for (size_t i = 0; i < count; i++) {
+		total += 1.0 / (i + 1);
+		cdf[i] = total;
+	}
+	std::vector<size_t> ranks(draws);
+	for (size_t& rank : ranks) {
+		double u = r.unit() * total;
+		rank = std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+		rank = std::min(rank, count - 1);
+	}
+	return ranks;
+}
+
+template <typename Splay>
+static void run(const char* policy, const std::vector<int>& keys,
+		const std::vector<int>& uniform, const std::vector<int>& zipf) {
+	// Every run peeks into a freshly built tree, and only the peeks are timed
+	auto measure = [&](const std::vector<int>& stream) {
+		double best = 0;
+		for (int run = 0; run < 3; run++) {
+			splay_tree<int,int,Splay> tree;
+			for (int key : keys) {
+				tree.insert(key, std::make_unique<int>(key));
+			}
+			double ns = bench::best_ns(1, [&] {
+				long sum = 0;
+				for (int key : stream) {
+					sum += *tree.peek(key);
+				}
+				bench::keep(sum);
+			});
+			if (run == 0 || ns < best) {
+				best = ns;
+			}
+		}
+		return best / stream.size();
+	};
+	double uniformNs = measure(uniform);
+	double zipfNs = measure(zipf);
+	std::printf("%-12s %10.1f %10.1f %10zu\n", policy, uniformNs, zipfNs,
+			sizeof(typename splay_tree<int,int,Splay>::splay_tree_node));
+	std::fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+	const size_t keyCount = bench::arg_count(argc, argv, 1, 1000000);
+	const size_t peekCount = bench::arg_count(argc, argv, 2, 4000000);
+
+	bench::rng r(8);
+	std::vector<int> keys(keyCount);
+	std::iota(keys.begin(), keys.end(), 0);
+	for (size_t i = keyCount; i > 1; i--) {
+		std::swap(keys[i - 1], keys[r.below(i)]);
+	}
+	std::vector<int> uniform(peekCount);
+	for (int& key : uniform) {
+		key = keys[r.below(keyCount)];
+	}
+	// keys is a random permutation, so rank i maps to an unrelated key
+	std::vector<int> zipf(peekCount);
+	std::vector<size_t> ranks = zipf_ranks(keyCount, peekCount, r);
+	for (size_t i = 0; i < peekCount; i++) {
+		zipf[i] = keys[ranks[i]];
+	}
+
+	std::printf("%zu keys, %zu peeks, ns per peek\n", keyCount, peekCount);
+	std::printf("%-12s %10s %10s %10s\n", "policy", "uniform", "zipf(1)", "node B");
+	run<bottom_up_splay>("bottom_up", keys, uniform, zipf);
+	run<top_down_splay>("top_down", keys, uniform, zipf);
+	run<semi_splay>("semi", keys, uniform, zipf);
+	run<periodic_splay<8>>("periodic<8>", keys, uniform, zipf);
+	run<depth_splay<16>>("depth<16>", keys, uniform, zipf);
+	run<no_splay>("no_splay", keys, uniform, zipf);
+	return 0;
+}
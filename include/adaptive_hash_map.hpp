@@ -1,32 +1,151 @@
 #pragma once
 #include <vector>
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
 #include <memory>
 #include "splay_tree.hpp"
+#include "hybrid_bucket.hpp"
+#include "probe_group.hpp"
+#include "hash_mix.hpp"
+#include "seeded_hash.hpp"
+#include "key_lookup.hpp"
 namespace cs251 {
 
-template <typename K, typename V>
+// Buckets holding up to four entries keep them inline, and larger ones in a
+// splay tree, see hybrid_bucket.hpp
+// Splay selects how the bucket trees restructure on access, see splay_tree.hpp
+// Hash maps a key to a size_t whose low bits pick the bucket
+// With a reseedable Hash such as seeded_hash, a bucket tree that grows
+// pathologically large reseeds and rehashes the table
+// With CacheHash, every node keeps the full hash of its key, so resizing
+// relinks nodes without calling the hasher again; by default only keys that
+// are costly to hash, such as strings, pay the extra word per node
+// With InlineValue, nodes hold V itself instead of a std::unique_ptr to it,
+// see value_storage.hpp and inline_adaptive_hash_map below
+template <typename K, typename V, typename Splay = bottom_up_splay, typename Hash = mixed_hash<K>,
+		bool CacheHash = cache_hash_codes<K>::value, bool InlineValue = false>
 class adaptive_hash_map {
+	using storage = value_storage<V, InlineValue>;
 public:
-	// Return a constant reference to the hash table vector
-	const std::vector<splay_tree<K,V>>& get_data() const;
+	// The hasher type
+	using hasher = Hash;
+	// The type of a bucket, whose larger ones are splay trees
+	using bucket_type = hybrid_bucket<splay_tree<K,V,Splay,CacheHash,InlineValue>>;
+	// What a node holds and extract returns: std::unique_ptr<V>, or V with InlineValue
+	using holder = typename storage::holder;
+	// What peek returns: const std::unique_ptr<V>&, or V& with InlineValue
+	using reference = typename storage::reference;
+	using const_reference = typename storage::const_reference;
+
+	// Read-only view of the buckets
+	// While an incremental rehash is running, the buckets still waiting to
+	// be migrated follow those of the current table
+	class data_view {
+	public:
+		data_view(const adaptive_hash_map& map) : m_map(map) {}
+		// Return the number of buckets in the table
+		size_t size() const { return m_map.m_data.size() + m_map.m_old_data.size(); }
+		// Return bucket index
+		const bucket_type& operator[](size_t index) const {
+			if (index < m_map.m_data.size()) {
+				return m_map.m_data[index];
+			}
+			return m_map.m_old_data[index - m_map.m_data.size()];
+		}
+	private:
+		const adaptive_hash_map& m_map;
+	};
+
+	// Return a view of the hash table buckets
+	data_view get_data() const;
 
 	// Default constructor - construct a hash table with a capacity of 1
 	adaptive_hash_map();
-	// Constructor - create a hash table with a capacity of bucketCount
-	adaptive_hash_map(size_t bucketCount);
+	// Constructor - create a hash table with a capacity of bucketCount,
+	// rounded up to a power of two
+	adaptive_hash_map(size_t bucketCount, const Hash& hash = Hash());
+	// Tables own their nodes, so they can be moved but not copied
+	adaptive_hash_map(adaptive_hash_map&& other) = default;
+	adaptive_hash_map& operator=(adaptive_hash_map&& other);
+	// Destroy every node
+	~adaptive_hash_map();
 
 	// Get the hash code for a given key
-	size_t hash_code(K key) const;
+	size_t hash_code(const K& key) const;
+
+	// Change the number of buckets to bucketCount rounded up to a power of
+	// two, moving every splay tree node
+	// into the tree of its new bucket rather than reallocating it
+	// An explicit resize always completes before returning
+	void resize(size_t bucketCount);
+	// Grow the table so that count elements fit without exceeding the maximum
+	// load factor, so a bulk load of count keys never rehashes midway
+	void reserve(size_t count);
 
 	// Insert the key/value pair into the table, if the key doesn't already exist
 	// Throw duplicate_key if the key already exists
+	// With InlineValue the value is moved out of its pointer, which must not
+	// be null, and std::invalid_argument is thrown if it is
 	void insert(const K& key, std::unique_ptr<V> value);
-	// Return a const reference to the value associated with the given key
+	// Insert key with a value constructed from args, and return the value
+	// Throw duplicate_key if the key already exists
+	template <typename... Args>
+	V& emplace(const K& key, Args&&... args);
+	// Same as emplace, but if the key already exists return its value and
+	// false without constructing anything
+	// The pointer is null only for a null value inserted by pointer
+	template <typename... Args>
+	std::pair<V*, bool> try_emplace(const K& key, Args&&... args);
+	// Return a reference to the value associated with the given key, or to
+	// its pointer without InlineValue; nodes never move, so it stays valid
+	// until the key is extracted
 	// Throw nonexistent_key if the key is not in the hash table
-	const std::unique_ptr<V>& peek(const K& key);
+	reference peek(const K& key);
+	// Same as peek, but never splays a bucket tree or migrates buckets, so
+	// concurrent readers may share the table as long as nothing modifies it
+	const_reference peek(const K& key) const;
 	// Remove and return the key-value pair associated with the given key
 	// Throw nonexistent_key if the key is not in the hash table
-	std::unique_ptr<V> extract(const K& key);
+	holder extract(const K& key);
+	// Same as peek and extract, for a key of another type Q that the hasher
+	// accepts and that compares against K (such as std::string_view for
+	// std::string keys), so no K has to be constructed for the lookup
+	template <typename Q, typename = std::enable_if_t<is_transparent_lookup<K,Hash,Q>::value>>
+	reference peek(const Q& key);
+	template <typename Q, typename = std::enable_if_t<is_transparent_lookup<K,Hash,Q>::value>>
+	const_reference peek(const Q& key) const;
+	template <typename Q, typename = std::enable_if_t<is_transparent_lookup<K,Hash,Q>::value>>
+	holder extract(const Q& key);
+
+	// Batched peek, insert and extract over a range of keys: each group of
+	// keys is hashed and has its buckets and first nodes prefetched
+	// before any of them is searched, so the cache misses of a group overlap
+	// instead of queuing up
+	// Write to out, for each key in [first, last), a pointer to its value, or
+	// nullptr if the key is absent, and return the end of the output
+	template <typename ForwardIt, typename OutputIt>
+	OutputIt peek_batch(ForwardIt first, ForwardIt last, OutputIt out);
+	// Insert the key-value pairs in [first, last), moving each pair's second,
+	// a holder, into the table; room for all of them is reserved up front
+	// Throw duplicate_key at the first key that already exists, after
+	// inserting those before it; that pair and the ones after it keep their values
+	template <typename ForwardIt>
+	void insert_batch(ForwardIt first, ForwardIt last);
+	// Same as insert_batch, but all or nothing, for loading many keys at once:
+	// the pairs are partitioned by bucket and sorted, and each bucket tree is
+	// rebuilt balanced in one pass instead of taking its keys one splay at a time
+	// Throw duplicate_key, before inserting or moving anything, if a key
+	// already exists or appears twice; if anything else throws, such as
+	// std::bad_alloc while a bucket turns into a tree, the keys already
+	// linked are taken out again and every value is moved back first
+	template <typename ForwardIt>
+	void insert_bulk(ForwardIt first, ForwardIt last);
+	// Remove the keys in [first, last), writing their values to out in
+	// order, and return the end of the output
+	// Throw nonexistent_key at the first absent key, after extracting those before it
+	template <typename ForwardIt, typename OutputIt>
+	OutputIt extract_batch(ForwardIt first, ForwardIt last, OutputIt out);
 
 	// Return the current number of elements in the hash table
 	size_t size() const;
@@ -35,77 +154,703 @@ public:
 	// Return whether the hash table is currently empty
 	bool empty() const;
 
+	// Return the current average number of elements per bucket
+	float load_factor() const;
+	// Return the load factor above which insert doubles the bucket count
+	float max_load_factor() const;
+	// Set the load factor above which insert doubles the bucket count
+	// Throw std::invalid_argument unless loadFactor > 0
+	void max_load_factor(float loadFactor);
+
+	// Return how many old buckets each operation migrates during a load-factor
+	// triggered rehash, or 0 if such a rehash happens all at once
+	size_t incremental_rehash() const;
+	// Spread load-factor triggered rehashes over later operations, each one
+	// migrating bucketsPerOperation old buckets, or 0 to rehash all at once
+	void incremental_rehash(size_t bucketsPerOperation);
+	// Return whether an incremental rehash is currently migrating buckets
+	bool rehashing() const;
+	// Return the fraction of the old buckets migrated so far, or 1 when idle
+	float rehash_progress() const;
+
 private:
-	// The hash table array of splay trees
-	std::vector<splay_tree<K,V>> m_data {};
-    // Bucket count for the adaptive hash table
+	// The thread-safe mode keeps one map per lock stripe and hands each the
+	// hash it already computed to pick the stripe
+	template <typename, typename, typename, typename, bool, bool>
+	friend class concurrent_adaptive_hash_map;
+
+	// Double the bucket count until count elements stay within the maximum load factor
+	void grow_for(size_t count);
+	// Start moving every node into a new table of bucketCount buckets, all at
+	// once or incrementally depending on m_rehash_step
+	void begin_rehash(size_t bucketCount);
+	// Move the nodes of up to bucketCount old buckets into the current table
+	void migrate(size_t bucketCount);
+	// Move the nodes of bucket into the current table in key order: the
+	// share of each new bucket stays sorted, so it is linked in with one
+	// linear pass instead of a descent and splay per node
+	void migrate_sorted(bucket_type& bucket);
+	// Destroy the nodes of every bucket, which keep no pointer to m_arena to
+	// do it themselves, leaving the buckets empty
+	void destroy_buckets();
+	// Return the bucket that currently owns a key with the given hash: its
+	// old bucket until that bucket has been migrated, its bucket in the
+	// current table afterwards
+	bucket_type& bucket_for_hash(size_t hash);
+	const bucket_type& bucket_for_hash(size_t hash) const;
+	// Return the hash of the key held by node, cached or computed
+	size_t node_hash(const typename splay_tree<K,V,Splay,CacheHash,InlineValue>::splay_tree_node& node) const;
+	// Bodies of peek and extract, shared by the K and heterogeneous overloads
+	template <typename Q>
+	reference peek_key(const Q& key, size_t hash);
+	template <typename Q>
+	const_reference peek_key(const Q& key, size_t hash) const;
+	template <typename Q>
+	holder extract_key(const Q& key, size_t hash);
+	// Hash the keys of up to batch_group_size elements from first on into
+	// hashes, saving their iterators in group, prefetching each key's bucket
+	// and then the node its lookup reads first; return how many were taken,
+	// advancing first
+	template <typename ForwardIt, typename Key>
+	size_t prefetch_group(ForwardIt& first, ForwardIt last, ForwardIt* group, size_t* hashes, Key key);
+	// Stably sort entries by the bucket index, hash & mask, of the hash in
+	// their first member: an LSD radix sort making one pass over them per
+	// radix_bits bits of mask, much cheaper than comparison sorting a bulk load
+	template <typename Entry>
+	static void sort_by_bucket(std::vector<Entry>& entries, size_t mask);
+	// Create a node for key, which has the given hash, and value in the arena
+	// and link it into its bucket, returning it
+	// Throw duplicate_key if the key already exists; on any throw value is
+	// handed back, so a batch leaves it with its pair
+	typename splay_tree<K,V,Splay,CacheHash,InlineValue>::splay_tree_node* insert_value(const K& key, size_t hash, holder&& value);
+	// Return the bucket size no insert should reach unless its keys
+	// were chosen to collide
+	static size_t pathological_bucket_size(size_t bucketCount);
+	// Pick a new seed and relink every node into its bucket under it, all at once
+	void reseed();
+
+	// The hash function
+	Hash m_hasher {};
+	// Node arena shared by every bucket, so a rehash can relink nodes
+	// from one bucket into another; declared first so it outlives the buckets
+	std::unique_ptr<typename splay_tree<K,V,Splay,CacheHash,InlineValue>::arena_type> m_arena
+        = std::make_unique<typename splay_tree<K,V,Splay,CacheHash,InlineValue>::arena_type>();
+	// The hash table array of buckets
+	std::vector<bucket_type> m_data {};
+    // Bucket count for the adaptive hash table, always a power of two
     size_t m_bucket_count = 0;
     // Size of the adaptive hash table
     size_t m_size = 0;
+    // Load factor above which the table grows, keeping bucket trees shallow
+    float m_max_load_factor = 1.0f;
+    // The buckets being drained by an incremental rehash, empty otherwise
+    std::vector<bucket_type> m_old_data {};
+    // The next bucket of m_old_data to migrate
+    size_t m_migrate_index = 0;
+    // Old buckets migrated per operation, or 0 to rehash all at once
+    size_t m_rehash_step = 0;
+    // The number of reseeds so far, so batches notice when their hashes go stale
+    size_t m_reseeds = 0;
+    // Keys a batch operation hashes and prefetches ahead of searching them
+    static constexpr size_t batch_group_size = 16;
+    // Bits of the bucket index sort_by_bucket sorts on per pass
+    static constexpr size_t radix_bits = 11;
+    // Old buckets this large are migrated by migrate_sorted; smaller ones
+    // are cheaper to insert node by node than to gather
+    static constexpr size_t sorted_migration_size = 8;
 };
 
-template <typename K, typename V>
-const std::vector<splay_tree<K,V>>& adaptive_hash_map<K,V>::get_data() const {
-	return m_data;
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+typename adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::data_view adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::get_data() const {
+	return data_view(*this);
 }
 
-template <typename K, typename V>
-adaptive_hash_map<K,V>::adaptive_hash_map() {
-    std::vector<splay_tree<K,V>> newTable(1);
-    m_data = std::move(newTable);
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::adaptive_hash_map() {
+    m_data = std::vector<bucket_type>(1);
     m_size = 0;
     m_bucket_count = 1;
 }
 
-template <typename K, typename V>
-adaptive_hash_map<K,V>::adaptive_hash_map(const size_t bucketCount) {
-    std::vector<splay_tree<K,V>> newTable(bucketCount);
-    m_data = std::move(newTable);
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::adaptive_hash_map(const size_t bucketCount, const Hash& hash) : m_hasher(hash) {
+    m_bucket_count = next_power_of_two(bucketCount);
+    m_data = std::vector<bucket_type>(m_bucket_count);
     m_size = 0;
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>& adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::operator=(adaptive_hash_map&& other) {
+    if (this != &other) {
+        destroy_buckets();
+        // The nodes are gone, so the arena can go with the buckets
+        m_hasher = std::move(other.m_hasher);
+        m_arena = std::move(other.m_arena);
+        m_data = std::move(other.m_data);
+        m_bucket_count = other.m_bucket_count;
+        m_size = other.m_size;
+        m_max_load_factor = other.m_max_load_factor;
+        m_old_data = std::move(other.m_old_data);
+        m_migrate_index = other.m_migrate_index;
+        m_rehash_step = other.m_rehash_step;
+        m_reseeds = other.m_reseeds;
+        other.m_data.clear();
+        other.m_old_data.clear();
+        other.m_size = 0;
+    }
+    return *this;
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::~adaptive_hash_map() {
+    destroy_buckets();
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+size_t adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::hash_code(const K& key) const {
+	return m_hasher(key) & (m_bucket_count - 1);
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+void adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::resize(const size_t bucketCount) {
+    if (bucketCount == 0 || next_power_of_two(bucketCount) == m_bucket_count) {
+        return;
+    }
+    size_t rehashStep = m_rehash_step;
+    m_rehash_step = 0;
+    begin_rehash(next_power_of_two(bucketCount));
+    m_rehash_step = rehashStep;
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+void adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::begin_rehash(size_t bucketCount) {
+    // Only one old table is kept, so finish any migration still running
+    migrate(m_old_data.size());
+    m_old_data = std::move(m_data);
+    m_data = std::vector<bucket_type>(bucketCount);
     m_bucket_count = bucketCount;
+    m_migrate_index = 0;
+    migrate(m_rehash_step == 0 ? m_old_data.size() : m_rehash_step);
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+void adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::migrate(size_t bucketCount) {
+    if (m_old_data.empty()) {
+        return;
+    }
+    for (size_t i = 0; i < bucketCount && m_migrate_index < m_old_data.size(); i++) {
+        bucket_type& old = m_old_data[m_migrate_index];
+        bucket_type& merged = m_data[m_migrate_index & (m_bucket_count - 1)];
+        if (m_bucket_count < m_old_data.size() && merged.empty()) {
+            // A shrinking table sends the whole bucket to one new bucket, so
+            // while that is empty it can take the bucket as it is
+            // Buckets are split by hash bits, not key order, so the key
+            // ranges of splay_tree::split and join never match a share, and
+            // migration does not use them
+            merged.swap(old);
+        } else if (old.size() < sorted_migration_size) {
+            old.release_nodes([&](typename splay_tree<K,V,Splay,CacheHash,InlineValue>::splay_tree_node* node) {
+                size_t hash = node_hash(*node);
+                m_data[hash & (m_bucket_count - 1)].insert_node(node, hash, *m_arena);
+            });
+        } else {
+            migrate_sorted(old);
+        }
+        m_migrate_index++;
+    }
+    if (m_migrate_index == m_old_data.size()) {
+        m_old_data.clear();
+        m_old_data.shrink_to_fit();
+        m_migrate_index = 0;
+    }
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+void adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::migrate_sorted(bucket_type& bucket) {
+    using node_type = typename splay_tree<K,V,Splay,CacheHash,InlineValue>::splay_tree_node;
+    // The nodes in key order with their hashes, and those of one new bucket
+    std::vector<std::pair<size_t, node_type*>> pending;
+    pending.reserve(bucket.size());
+    std::vector<node_type*> share;
+    share.reserve(bucket.size());
+    std::vector<size_t> shareHashes;
+    shareHashes.reserve(bucket.size());
+    bucket.release_nodes([&](node_type* node) {
+        pending.emplace_back(node_hash(*node), node);
+    });
+    // Take the share of the first pending node's bucket out, keeping the
+    // rest in order, until none is left; a bucket splits into few shares
+    size_t mask = m_bucket_count - 1;
+    while (!pending.empty()) {
+        size_t target = pending.front().first & mask;
+        size_t kept = 0;
+        share.clear();
+        shareHashes.clear();
+        for (const std::pair<size_t, node_type*>& entry : pending) {
+            if ((entry.first & mask) == target) {
+                share.push_back(entry.second);
+                shareHashes.push_back(entry.first);
+            } else {
+                pending[kept++] = entry;
+            }
+        }
+        pending.resize(kept);
+        m_data[target].insert_sorted_nodes(share.data(), shareHashes.data(), share.size(), *m_arena);
+    }
 }
 
-template <typename K, typename V>
-size_t adaptive_hash_map<K,V>::hash_code(K key) const {
-	return key % m_bucket_count;
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+void adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::destroy_buckets() {
+    for (bucket_type& bucket : m_data) {
+        bucket.destroy_nodes(*m_arena);
+    }
+    for (bucket_type& bucket : m_old_data) {
+        bucket.destroy_nodes(*m_arena);
+    }
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+typename adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::bucket_type& adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::bucket_for_hash(size_t hash) {
+    return const_cast<bucket_type&>(static_cast<const adaptive_hash_map&>(*this).bucket_for_hash(hash));
 }
 
-template <typename K, typename V>void adaptive_hash_map<K,V>::insert(const K& key, std::unique_ptr<V> value) {
-    size_t code = hash_code(key);
-    m_data[code].insert(key, std::move(value));
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+const typename adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::bucket_type& adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::bucket_for_hash(size_t hash) const {
+    if (!m_old_data.empty()) {
+        size_t oldCode = hash & (m_old_data.size() - 1);
+        if (oldCode >= m_migrate_index) {
+            return m_old_data[oldCode];
+        }
+    }
+    return m_data[hash & (m_bucket_count - 1)];
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+size_t adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::node_hash(
+        const typename splay_tree<K,V,Splay,CacheHash,InlineValue>::splay_tree_node& node) const {
+    if constexpr (CacheHash) {
+        return node.m_hash;
+    } else {
+        return m_hasher(node.m_key);
+    }
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+void adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::reserve(size_t count) {
+    grow_for(count);
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+void adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::grow_for(size_t count) {
+    size_t bucketCount = m_bucket_count;
+    while (count > m_max_load_factor * bucketCount) {
+        bucketCount *= 2;
+    }
+    if (bucketCount != m_bucket_count) {
+        begin_rehash(bucketCount);
+    }
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+void adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::insert(const K& key, std::unique_ptr<V> value) {
+    migrate(m_rehash_step);
+    insert_value(key, m_hasher(key), storage::from_pointer(std::move(value)));
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+template <typename... Args>
+V& adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::emplace(const K& key, Args&&... args) {
+    migrate(m_rehash_step);
+    return *storage::get(insert_value(key, m_hasher(key), storage::make(std::forward<Args>(args)...))->m_value);
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+template <typename... Args>
+std::pair<V*, bool> adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::try_emplace(const K& key, Args&&... args) {
+    migrate(m_rehash_step);
+    size_t hash = m_hasher(key);
+    typename splay_tree<K,V,Splay,CacheHash,InlineValue>::splay_tree_node* existing = bucket_for_hash(hash).find_node(key, hash);
+    if (existing != nullptr) {
+        return { storage::get(existing->m_value), false };
+    }
+    return { storage::get(insert_value(key, hash, storage::make(std::forward<Args>(args)...))->m_value), true };
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+typename splay_tree<K,V,Splay,CacheHash,InlineValue>::splay_tree_node* adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::insert_value(
+        const K& key, size_t hash, holder&& value) {
+    bucket_type& bucket = bucket_for_hash(hash);
+    typename splay_tree<K,V,Splay,CacheHash,InlineValue>::splay_tree_node* node = m_arena->create();
+    // A key that fails to copy, a duplicate key, or a tree the bucket
+    // failed to allocate leaves the bucket as it was and the node destroyed
+    bool moved = false;
+    try {
+        node->m_key = key;
+        node->m_value = std::move(value);
+        moved = true;
+        if constexpr (CacheHash) {
+            node->m_hash = hash;
+        }
+        bucket.insert_node(node, hash, *m_arena);
+    } catch (...) {
+        if (moved) {
+            value = std::move(node->m_value);
+        }
+        m_arena->destroy(node);
+        throw;
+    }
     m_size++;
+    if constexpr (is_reseedable<Hash>::value) {
+        if (bucket.size() > pathological_bucket_size(m_bucket_count)) {
+            reseed();
+        }
+    }
+    // Rehashing relinks nodes without moving them, so node stays valid
+    grow_for(m_size);
+    return node;
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+size_t adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::pathological_bucket_size(size_t bucketCount) {
+    // The fullest of n buckets holding about n random keys has only about
+    // log n / log log n of them
+    return 32 + 4 * floor_log2(bucketCount);
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+void adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::reseed() {
+    // Buckets still in the old table were filled under the old seed
+    migrate(m_old_data.size());
+    m_hasher.reseed();
+    m_reseeds++;
+    std::vector<bucket_type> old = std::move(m_data);
+    m_data = std::vector<bucket_type>(m_bucket_count);
+    for (bucket_type& bucket : old) {
+        bucket.release_nodes([&](typename splay_tree<K,V,Splay,CacheHash,InlineValue>::splay_tree_node* node) {
+            // Cached hashes were computed under the old seed
+            size_t hash = m_hasher(node->m_key);
+            if constexpr (CacheHash) {
+                node->m_hash = hash;
+            }
+            m_data[hash & (m_bucket_count - 1)].insert_node(node, hash, *m_arena);
+        });
+    }
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+typename adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::reference adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::peek(const K& key) {
+    return peek_key(key, m_hasher(key));
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+typename adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::const_reference adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::peek(const K& key) const {
+    return peek_key(key, m_hasher(key));
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+typename adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::holder adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::extract(const K& key) {
+    return extract_key(key, m_hasher(key));
 }
 
-template <typename K, typename V>
-const std::unique_ptr<V>& adaptive_hash_map<K,V>::peek(const K& key) {
-    size_t code = hash_code(key);
-    return m_data[code].peek(key);
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+template <typename Q, typename>
+typename adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::reference adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::peek(const Q& key) {
+    return peek_key(key, m_hasher(key));
 }
 
-template <typename K, typename V>
-std::unique_ptr<V> adaptive_hash_map<K,V>::extract(const K& key) {
-    size_t code = hash_code(key);
-    std::unique_ptr<V> value = m_data[code].extract(key);
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+template <typename Q, typename>
+typename adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::const_reference adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::peek(const Q& key) const {
+    return peek_key(key, m_hasher(key));
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+template <typename Q, typename>
+typename adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::holder adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::extract(const Q& key) {
+    return extract_key(key, m_hasher(key));
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+template <typename Q>
+typename adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::reference adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::peek_key(const Q& key, size_t hash) {
+    migrate(m_rehash_step);
+    typename splay_tree<K,V,Splay,CacheHash,InlineValue>::splay_tree_node* node = bucket_for_hash(hash).find_node(key, hash);
+    if (node == nullptr) {
+        throw nonexistent_key();
+    }
+    return node->m_value;
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+template <typename Q>
+typename adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::const_reference adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::peek_key(const Q& key, size_t hash) const {
+    const typename splay_tree<K,V,Splay,CacheHash,InlineValue>::splay_tree_node* node = bucket_for_hash(hash).find_node(key, hash);
+    if (node == nullptr) {
+        throw nonexistent_key();
+    }
+    return node->m_value;
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+template <typename Q>
+typename adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::holder adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::extract_key(const Q& key, size_t hash) {
+    migrate(m_rehash_step);
+    holder value = bucket_for_hash(hash).extract(key, hash, *m_arena, [this](const typename splay_tree<K,V,Splay,CacheHash,InlineValue>::splay_tree_node& node) {
+        return node_hash(node);
+    });
     m_size--;
     return value;
 }
 
-template <typename K, typename V>
-size_t adaptive_hash_map<K,V>::size() const {
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+template <typename ForwardIt, typename Key>
+size_t adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::prefetch_group(
+        ForwardIt& first, ForwardIt last, ForwardIt* group, size_t* hashes, Key key) {
+    size_t count = 0;
+    for (; count < batch_group_size && first != last; ++first, ++count) {
+        group[count] = first;
+        hashes[count] = m_hasher(key(first));
+        prefetch(&bucket_for_hash(hashes[count]));
+    }
+    // By now the first buckets have arrived, so their nodes can be fetched
+    for (size_t i = 0; i < count; i++) {
+        bucket_for_hash(hashes[i]).prefetch_node(hashes[i]);
+    }
+    return count;
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+template <typename ForwardIt, typename OutputIt>
+OutputIt adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::peek_batch(ForwardIt first, ForwardIt last, OutputIt out) {
+    ForwardIt keys[batch_group_size];
+    size_t hashes[batch_group_size];
+    while (first != last) {
+        migrate(m_rehash_step);
+        size_t count = prefetch_group(first, last, keys, hashes, [](ForwardIt it) -> const K& { return *it; });
+        for (size_t i = 0; i < count; i++) {
+            typename splay_tree<K,V,Splay,CacheHash,InlineValue>::splay_tree_node* node
+                    = bucket_for_hash(hashes[i]).find_node(*keys[i], hashes[i]);
+            *out++ = node == nullptr ? nullptr : storage::get(node->m_value);
+        }
+    }
+    return out;
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+template <typename ForwardIt>
+void adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::insert_batch(ForwardIt first, ForwardIt last) {
+    // Growing now keeps the buckets, and so the prefetched nodes, in place
+    grow_for(m_size + static_cast<size_t>(std::distance(first, last)));
+    ForwardIt pairs[batch_group_size];
+    size_t hashes[batch_group_size];
+    while (first != last) {
+        size_t reseeds = m_reseeds;
+        size_t count = prefetch_group(first, last, pairs, hashes, [](ForwardIt it) -> const K& { return it->first; });
+        for (size_t i = 0; i < count; i++) {
+            if (m_reseeds != reseeds) {
+                // An insert of this group reseeded, so the hashes computed before are stale
+                hashes[i] = m_hasher(pairs[i]->first);
+            }
+            migrate(m_rehash_step);
+            insert_value(pairs[i]->first, hashes[i], std::move(pairs[i]->second));
+        }
+    }
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+template <typename ForwardIt>
+void adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::insert_bulk(ForwardIt first, ForwardIt last) {
+    using node_type = typename splay_tree<K,V,Splay,CacheHash,InlineValue>::splay_tree_node;
+    size_t count = static_cast<size_t>(std::distance(first, last));
+    grow_for(m_size + count);
+    // Every key must go straight to its bucket in the new table
+    migrate(m_old_data.size());
+    // The pairs with their hashes, in bucket and then key order
+    std::vector<std::pair<size_t, ForwardIt>> sorted;
+    sorted.reserve(count);
+    for (ForwardIt current = first; current != last; ++current) {
+        sorted.emplace_back(m_hasher(current->first), current);
+    }
+    size_t mask = m_bucket_count - 1;
+    sort_by_bucket(sorted, mask);
+    // Runs of pairs bound for one bucket are short, so sorting each of them
+    // by key is cheap, and checking them against the bucket never splays
+    for (size_t begin = 0, end = 0; begin < count; begin = end) {
+        end = begin + 1;
+        while (end < count && (sorted[end].first & mask) == (sorted[begin].first & mask)) {
+            end++;
+        }
+        std::sort(sorted.begin() + begin, sorted.begin() + end, [](const std::pair<size_t, ForwardIt>& a, const std::pair<size_t, ForwardIt>& b) {
+            return a.second->first < b.second->first;
+        });
+        const bucket_type& bucket = m_data[sorted[begin].first & mask];
+        for (size_t i = begin; i < end; i++) {
+            if ((i > begin && !(sorted[i - 1].second->first < sorted[i].second->first))
+                    || bucket.find_node(sorted[i].second->first, sorted[i].first) != nullptr) {
+                throw duplicate_key();
+            }
+        }
+    }
+    // Create the nodes in bucket order, so each bucket's nodes sit together
+    std::vector<node_type*> nodes;
+    nodes.reserve(count);
+    std::vector<size_t> hashes;
+    hashes.reserve(count);
+    try {
+        for (const std::pair<size_t, ForwardIt>& entry : sorted) {
+            node_type* node = m_arena->create();
+            nodes.push_back(node);
+            hashes.push_back(entry.first);
+            // Value first, so a key that fails to copy leaves it to be moved back
+            node->m_value = std::move(entry.second->second);
+            node->m_key = entry.second->first;
+            if constexpr (CacheHash) {
+                node->m_hash = entry.first;
+            }
+        }
+    } catch (...) {
+        for (size_t i = 0; i < nodes.size(); i++) {
+            sorted[i].second->second = std::move(nodes[i]->m_value);
+            m_arena->destroy(nodes[i]);
+        }
+        throw;
+    }
+    bool pathological = false;
+    // Nodes before linked are in their buckets; a bucket that throws keeps
+    // none of the nodes it was given
+    size_t linked = 0;
+    try {
+        for (size_t end = 0; linked < count; linked = end) {
+            end = linked + 1;
+            while (end < count && (sorted[end].first & mask) == (sorted[linked].first & mask)) {
+                end++;
+            }
+            bucket_type& bucket = m_data[sorted[linked].first & mask];
+            bucket.insert_sorted_nodes(nodes.data() + linked, hashes.data() + linked, end - linked, *m_arena);
+            pathological = pathological || bucket.size() > pathological_bucket_size(m_bucket_count);
+        }
+    } catch (...) {
+        for (size_t i = 0; i < linked; i++) {
+            sorted[i].second->second = m_data[hashes[i] & mask].extract(sorted[i].second->first, hashes[i], *m_arena,
+                    [this](const node_type& node) { return node_hash(node); });
+        }
+        for (size_t i = linked; i < count; i++) {
+            sorted[i].second->second = std::move(nodes[i]->m_value);
+            m_arena->destroy(nodes[i]);
+        }
+        throw;
+    }
+    m_size += count;
+    if constexpr (is_reseedable<Hash>::value) {
+        if (pathological) {
+            reseed();
+        }
+    }
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+template <typename Entry>
+void adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::sort_by_bucket(std::vector<Entry>& entries, size_t mask) {
+    constexpr size_t radix_size = size_t(1) << radix_bits;
+    std::vector<Entry> buffer(entries.size());
+    size_t counts[radix_size];
+    for (size_t shift = 0; (mask >> shift) != 0; shift += radix_bits) {
+        std::fill(counts, counts + radix_size, 0);
+        for (const Entry& entry : entries) {
+            counts[((entry.first & mask) >> shift) & (radix_size - 1)]++;
+        }
+        size_t offset = 0;
+        for (size_t& count : counts) {
+            size_t digitCount = count;
+            count = offset;
+            offset += digitCount;
+        }
+        for (Entry& entry : entries) {
+            buffer[counts[((entry.first & mask) >> shift) & (radix_size - 1)]++] = std::move(entry);
+        }
+        entries.swap(buffer);
+    }
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+template <typename ForwardIt, typename OutputIt>
+OutputIt adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::extract_batch(ForwardIt first, ForwardIt last, OutputIt out) {
+    ForwardIt keys[batch_group_size];
+    size_t hashes[batch_group_size];
+    while (first != last) {
+        size_t count = prefetch_group(first, last, keys, hashes, [](ForwardIt it) -> const K& { return *it; });
+        for (size_t i = 0; i < count; i++) {
+            *out++ = extract_key(*keys[i], hashes[i]);
+        }
+    }
+    return out;
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+size_t adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::size() const {
     return m_size;
 }
 
-template <typename K, typename V>
-size_t adaptive_hash_map<K,V>::bucket_count() const {
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+size_t adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::bucket_count() const {
     return m_bucket_count;
 }
 
-template <typename K, typename V>
-bool adaptive_hash_map<K,V>::empty() const {
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+bool adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::empty() const {
     if (m_size == 0) {
         return true;    
     }
     return false;
 }
 
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+float adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::load_factor() const {
+    return static_cast<float>(m_size) / m_bucket_count;
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+float adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::max_load_factor() const {
+    return m_max_load_factor;
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+void adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::max_load_factor(float loadFactor) {
+    if (!(loadFactor > 0.0f)) {
+        throw std::invalid_argument("Invalid maximum load factor!");
+    }
+    m_max_load_factor = loadFactor;
+    grow_for(m_size);
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+size_t adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::incremental_rehash() const {
+    return m_rehash_step;
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+void adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::incremental_rehash(size_t bucketsPerOperation) {
+    m_rehash_step = bucketsPerOperation;
+    if (m_rehash_step == 0) {
+        migrate(m_old_data.size());
+    }
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+bool adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::rehashing() const {
+    return !m_old_data.empty();
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+float adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::rehash_progress() const {
+    if (m_old_data.empty()) {
+        return 1.0f;
+    }
+    return static_cast<float>(m_migrate_index) / m_old_data.size();
+}
+
+// adaptive_hash_map whose nodes hold values inline, for small values such as numbers
+template <typename K, typename V, typename Splay = bottom_up_splay, typename Hash = mixed_hash<K>>
+using inline_adaptive_hash_map = adaptive_hash_map<K, V, Splay, Hash, cache_hash_codes<K>::value, true>;
+
 }
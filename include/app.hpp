@@ -1,13 +1,19 @@
 #pragma once
 #include <iostream>
+#include <string>
+#include <string_view>
+#include "hash_mix.hpp"
+#include "small_string.hpp"
 
 // Custom name class
+// Both names are small strings, so a typical name takes no heap allocation
+// and a table entry keyed by it stays 16 bytes smaller than with std::string
 class name {
 public:
-	std::string m_first;
-	std::string m_last;
+	cs251::small_string m_first;
+	cs251::small_string m_last;
 	name() {}
-	name(std::string first, std::string last) : m_first(first), m_last(last) {}
+	name(std::string_view first, std::string_view last) : m_first(first), m_last(last) {}
 
 	// Operator overloads
 	bool operator==(const name& other) const;
@@ -19,17 +25,52 @@ public:
 	size_t operator%(size_t m) const;
 };
 
-// Hash function - combines hashes of underlying strings
+// Non-owning view of a name, so containers keyed by name can be searched
+// by a first and last name without copying either into a name
+class name_view {
+public:
+	std::string_view m_first;
+	std::string_view m_last;
+	name_view(std::string_view first, std::string_view last) : m_first(first), m_last(last) {}
+	name_view(const name& n) : m_first(n.m_first), m_last(n.m_last) {}
+};
+
+// Comparisons between views, and through the conversion above between a
+// view and a name, ordered like name
+bool operator==(const name_view& a, const name_view& b);
+bool operator!=(const name_view& a, const name_view& b);
+bool operator<(const name_view& a, const name_view& b);
+bool operator>(const name_view& a, const name_view& b);
+
+// Hash function - combines hashes of underlying strings in order, so names
+// with swapped or equal first and last names do not collide
+// A name and a view of it hash alike, as std::string and std::string_view do
 namespace std {
+template <> struct hash<name_view> {
+	size_t operator()(const name_view& n) const noexcept {
+		size_t h1 = std::hash<std::string_view>{}(n.m_first);
+		size_t h2 = std::hash<std::string_view>{}(n.m_last);
+		return cs251::hash_combine(h1, h2);
+	}
+};
 template <> struct hash<name> {
 	size_t operator()(const name& n) const noexcept {
-		size_t h1 = std::hash<std::string>{}(n.m_first);
-		size_t h2 = std::hash<std::string>{}(n.m_last);
-		return h1 ^ (h2 << 1);
+		return std::hash<name_view>{}(n);
 	}
 };
 }
 
+// Feed both names to a keyed hasher such as cs251::seeded_hash
+template <typename H>
+void hash_append(H& hasher, const name_view& n) {
+	hash_append(hasher, n.m_first);
+	hash_append(hasher, n.m_last);
+}
+template <typename H>
+void hash_append(H& hasher, const name& n) {
+	hash_append(hasher, name_view(n));
+}
+
 // Comparison operators
 bool name::operator==(const name& other) const {
 	return m_first == other.m_first && m_last == other.m_last;
@@ -39,10 +80,7 @@ bool name::operator!=(const name& other) const {
 }
 // Sort by last name first
 bool name::operator<(const name& other) const {
-	if (m_last == other.m_last)
-		return m_first < other.m_first;
-	else
-		return m_last < other.m_last;
+	return name_view(*this) < name_view(other);
 }
 bool name::operator>(const name& other) const {
 	return other < *this;
@@ -54,6 +92,24 @@ bool name::operator>=(const name& other) const {
 	return !(*this < other);
 }
 
+bool operator==(const name_view& a, const name_view& b) {
+	return a.m_first == b.m_first && a.m_last == b.m_last;
+}
+bool operator!=(const name_view& a, const name_view& b) {
+	return !(a == b);
+}
+// One three-way comparison of the last names decides most pairs
+bool operator<(const name_view& a, const name_view& b) {
+	int last = a.m_last.compare(b.m_last);
+	if (last == 0)
+		return a.m_first < b.m_first;
+	else
+		return last < 0;
+}
+bool operator>(const name_view& a, const name_view& b) {
+	return b < a;
+}
+
 // Modulus operator
 size_t name::operator%(size_t m) const {
 	return std::hash<name>{}(*this) % m;
@@ -0,0 +1,235 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
+#include "adaptive_hash_map.hpp"
+namespace cs251 {
+
+// Thread-safe mode of adaptive_hash_map whose buckets are guarded by striped
+// locks: the bits of a hash just below its top byte pick a stripe, and each
+// stripe is an adaptive_hash_map holding the buckets of its keys, so hybrid
+// buckets, rehashing, migration and reseeding all work as in a single map,
+// one stripe at a time, and an operation takes exactly one stripe lock
+// A key is hashed once: its stripe's map files it under the same hash, until
+// a reseedable Hash gives that map a seed of its own
+// The template parameters are those of adaptive_hash_map
+// A lookup that gets its stripe lock exclusively splays as usual. When the
+// stripe is busy, whether with a writer or with other readers, it waits for
+// a shared lock and reads without splaying, so hot buckets do not serialize
+// their readers; the flip side is that the buckets of a stripe under
+// constant contention are never restructured by lookups
+template <typename K, typename V, typename Splay = bottom_up_splay, typename Hash = mixed_hash<K>,
+		bool CacheHash = cache_hash_codes<K>::value, bool InlineValue = false>
+class concurrent_adaptive_hash_map {
+	// The map of one stripe
+	using map_type = adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>;
+	using storage = value_storage<V, InlineValue>;
+public:
+	// The hasher type
+	using hasher = Hash;
+	// What extract returns: std::unique_ptr<V>, or V with InlineValue
+	using holder = typename map_type::holder;
+
+	// Default constructor - four stripes per hardware thread, one bucket each
+	concurrent_adaptive_hash_map();
+	// Constructor - create stripeCount stripes and bucketCount buckets, both
+	// rounded up to a power of two and with at least one bucket per stripe
+	concurrent_adaptive_hash_map(size_t bucketCount, size_t stripeCount, const Hash& hash = Hash());
+	concurrent_adaptive_hash_map(const concurrent_adaptive_hash_map&) = delete;
+	concurrent_adaptive_hash_map& operator=(const concurrent_adaptive_hash_map&) = delete;
+
+	// Insert the key/value pair into the table, if the key doesn't already exist
+	// Throw duplicate_key if the key already exists
+	void insert(const K& key, std::unique_ptr<V> value);
+	// Return a copy of the value associated with the given key, since a
+	// reference would outlive the stripe lock
+	// Throw nonexistent_key if the key is not in the hash table
+	V peek(const K& key);
+	// Call visitor with a const reference to the value associated with the
+	// given key while its stripe is locked, for values that are not copyable
+	// Throw nonexistent_key if the key is not in the hash table
+	template <typename F>
+	void visit(const K& key, F&& visitor);
+	// Remove and return the value associated with the given key
+	// Throw nonexistent_key if the key is not in the hash table
+	holder extract(const K& key);
+
+	// Return the current number of elements, summed over the stripe counters
+	// without taking any lock, so it may lag behind operations still running
+	size_t size() const;
+	// Return the current number of buckets, summed the same way
+	size_t bucket_count() const;
+	// Return the number of lock stripes
+	size_t stripe_count() const;
+	// Return whether the hash table is currently empty
+	bool empty() const;
+	// Return the load factor above which a stripe doubles its bucket count
+	float max_load_factor() const;
+
+private:
+	// One stripe of the buckets, on cache lines of its own
+	struct alignas(64) stripe {
+		// Exclusive to modify or splay the stripe's buckets, shared to read them
+		mutable std::shared_mutex m_mutex;
+		// The buckets of every key whose hash picks this stripe
+		map_type m_map;
+		// Copies of m_map.size() and m_map.bucket_count() readable without the lock
+		std::atomic<size_t> m_size{0};
+		std::atomic<size_t> m_bucket_count{0};
+	};
+
+	// Return the stripe that owns a key with the given hash
+	stripe& stripe_for(size_t hash);
+	// Return the hash the map of s files key under, given the stripe hash
+	static size_t map_hash(const stripe& s, const K& key, size_t hash);
+	// Copy the size and bucket count of s to its counters; s must be locked
+	static void publish_counts(stripe& s);
+	// Pass the value of key to use, splaying its bucket only if its stripe
+	// lock is free, while holding the lock that was taken
+	template <typename F>
+	void with_value(const K& key, F&& use);
+
+	// The hash function picking stripes; every stripe hashes with a copy
+	Hash m_hasher {};
+	// The lock stripes, m_stripe_count of them
+	std::unique_ptr<stripe[]> m_stripes;
+	// The number of stripes, always a power of two
+	size_t m_stripe_count = 0;
+	// Right shift that brings the stripe bits of a hash to the bottom
+	unsigned m_stripe_shift = 0;
+};
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+concurrent_adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::concurrent_adaptive_hash_map()
+        : concurrent_adaptive_hash_map(1, 4 * std::max(1u, std::thread::hardware_concurrency())) {
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+concurrent_adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::concurrent_adaptive_hash_map(
+        size_t bucketCount, size_t stripeCount, const Hash& hash) : m_hasher(hash) {
+    m_stripe_count = next_power_of_two(stripeCount);
+    m_stripe_shift = sizeof(size_t) * 8 - 8;
+    for (size_t count = m_stripe_count; count > 1; count /= 2) {
+        m_stripe_shift--;
+    }
+    m_stripes = std::unique_ptr<stripe[]>(new stripe[m_stripe_count]);
+    size_t stripeBuckets = std::max<size_t>(1, next_power_of_two(bucketCount) / m_stripe_count);
+    for (size_t i = 0; i < m_stripe_count; i++) {
+        m_stripes[i].m_map = map_type(stripeBuckets, hash);
+        publish_counts(m_stripes[i]);
+    }
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+typename concurrent_adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::stripe&
+        concurrent_adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::stripe_for(size_t hash) {
+    // The low bits pick a bucket inside the stripe and the top byte a bucket
+    // tag, so use neither
+    return m_stripes[(hash >> m_stripe_shift) & (m_stripe_count - 1)];
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+size_t concurrent_adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::map_hash(const stripe& s, const K& key, size_t hash) {
+    if constexpr (is_reseedable<Hash>::value) {
+        if (s.m_map.m_reseeds != 0) {
+            return s.m_map.m_hasher(key);
+        }
+    }
+    return hash;
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+void concurrent_adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::publish_counts(stripe& s) {
+    s.m_size.store(s.m_map.size(), std::memory_order_relaxed);
+    s.m_bucket_count.store(s.m_map.bucket_count(), std::memory_order_relaxed);
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+void concurrent_adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::insert(const K& key, std::unique_ptr<V> value) {
+    size_t hash = m_hasher(key);
+    stripe& s = stripe_for(hash);
+    std::unique_lock<std::shared_mutex> lock(s.m_mutex);
+    s.m_map.insert_value(key, map_hash(s, key, hash), storage::from_pointer(std::move(value)));
+    publish_counts(s);
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+template <typename F>
+void concurrent_adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::with_value(const K& key, F&& use) {
+    size_t hash = m_hasher(key);
+    stripe& s = stripe_for(hash);
+    std::unique_lock<std::shared_mutex> lock(s.m_mutex, std::try_to_lock);
+    if (lock.owns_lock()) {
+        use(storage::deref(s.m_map.peek_key(key, map_hash(s, key, hash))));
+        return;
+    }
+    // Someone else holds the stripe; read without splaying rather than queue up
+    std::shared_lock<std::shared_mutex> shared(s.m_mutex);
+    const map_type& map = s.m_map;
+    use(storage::deref(map.peek_key(key, map_hash(s, key, hash))));
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+V concurrent_adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::peek(const K& key) {
+    std::optional<V> copy;
+    with_value(key, [&](const V& value) { copy.emplace(value); });
+    return std::move(*copy);
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+template <typename F>
+void concurrent_adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::visit(const K& key, F&& visitor) {
+    with_value(key, [&](const V& value) { visitor(value); });
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+typename concurrent_adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::holder
+        concurrent_adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::extract(const K& key) {
+    size_t hash = m_hasher(key);
+    stripe& s = stripe_for(hash);
+    std::unique_lock<std::shared_mutex> lock(s.m_mutex);
+    holder value = s.m_map.extract_key(key, map_hash(s, key, hash));
+    publish_counts(s);
+    return value;
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+size_t concurrent_adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::size() const {
+    size_t total = 0;
+    for (size_t i = 0; i < m_stripe_count; i++) {
+        total += m_stripes[i].m_size.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+size_t concurrent_adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::bucket_count() const {
+    size_t total = 0;
+    for (size_t i = 0; i < m_stripe_count; i++) {
+        total += m_stripes[i].m_bucket_count.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+size_t concurrent_adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::stripe_count() const {
+    return m_stripe_count;
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+bool concurrent_adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::empty() const {
+    return size() == 0;
+}
+
+template <typename K, typename V, typename Splay, typename Hash, bool CacheHash, bool InlineValue>
+float concurrent_adaptive_hash_map<K,V,Splay,Hash,CacheHash,InlineValue>::max_load_factor() const {
+    // Every stripe keeps the default of its map
+    std::shared_lock<std::shared_mutex> lock(m_stripes[0].m_mutex);
+    return m_stripes[0].m_map.max_load_factor();
+}
+
+}
@@ -0,0 +1,164 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <type_traits>
+#include "hash_map.hpp"
+namespace cs251 {
+
+// Thread-safe map that partitions keys over independently locked shards, each
+// one a hash_map, adaptive_hash_map, or any map with the same interface and
+// a hasher type, whose bits just below the top byte pick the shard
+// Writers lock a single shard exclusively, readers share it with each other
+// Shards may hold their values inline, as inline_hash_map does; extract then
+// returns the value itself, like the shard map's own extract
+template <typename K, typename V, typename Map = hash_map<K,V>>
+class concurrent_hash_map {
+	// How the shard maps hold values: inline exactly when extract returns V
+	using storage = value_storage<V, std::is_same_v<typename Map::holder, V>>;
+public:
+	// What extract returns: std::unique_ptr<V>, or V for inline shard maps
+	using holder = typename Map::holder;
+
+	// Default constructor - four shards per hardware thread
+	concurrent_hash_map();
+	// Constructor - create at least shardCount shards, rounded up to a power of two
+	explicit concurrent_hash_map(size_t shardCount);
+	concurrent_hash_map(const concurrent_hash_map&) = delete;
+	concurrent_hash_map& operator=(const concurrent_hash_map&) = delete;
+
+	// Insert the key/value pair into the map, if the key doesn't already exist
+	// Throw duplicate_key if the key already exists
+	void insert(const K& key, std::unique_ptr<V> value);
+	// Return a copy of the value associated with the given key, since a
+	// reference would outlive the shard lock
+	// Throw nonexistent_key if the key is not in the map
+	V peek(const K& key) const;
+	// Call visitor with a const reference to the value associated with the
+	// given key while its shard is read-locked, for values that are not copyable
+	// Throw nonexistent_key if the key is not in the map
+	template <typename F>
+	void visit(const K& key, F&& visitor) const;
+	// Remove and return the value associated with the given key
+	// Throw nonexistent_key if the key is not in the map
+	holder extract(const K& key);
+
+	// Return the current number of elements, summed over the shard counters
+	// without taking any lock, so it may lag behind operations still running
+	size_t size() const;
+	// Return whether the map is currently empty
+	bool empty() const;
+	// Return the number of shards
+	size_t shard_count() const;
+
+private:
+	// One partition of the key space, padded to a cache line of its own so
+	// threads working on neighbouring shards do not share lines
+	struct alignas(64) shard {
+		// Exclusive for insert and extract, shared for lookups
+		mutable std::shared_mutex m_mutex;
+		// The elements whose keys select this shard
+		Map m_map;
+		// Copy of m_map.size() readable without the lock
+		std::atomic<size_t> m_size{0};
+	};
+
+	// Return the shard that owns key
+	shard& shard_for(const K& key);
+	const shard& shard_for(const K& key) const;
+
+	// The shards, m_shard_count of them
+	std::unique_ptr<shard[]> m_shards;
+	// The number of shards, always a power of two
+	size_t m_shard_count = 0;
+	// Right shift that brings the shard bits of a hash to the bottom
+	unsigned m_shard_shift = 0;
+	// The hash function of the shard maps
+	typename Map::hasher m_hasher {};
+};
+
+template <typename K, typename V, typename Map>
+concurrent_hash_map<K,V,Map>::concurrent_hash_map()
+        : concurrent_hash_map(4 * std::max(1u, std::thread::hardware_concurrency())) {
+}
+
+template <typename K, typename V, typename Map>
+concurrent_hash_map<K,V,Map>::concurrent_hash_map(size_t shardCount) {
+    m_shard_count = next_power_of_two(shardCount);
+    m_shard_shift = sizeof(size_t) * 8 - 8;
+    for (size_t count = m_shard_count; count > 1; count /= 2) {
+        m_shard_shift--;
+    }
+    m_shards = std::unique_ptr<shard[]>(new shard[m_shard_count]);
+}
+
+template <typename K, typename V, typename Map>
+typename concurrent_hash_map<K,V,Map>::shard& concurrent_hash_map<K,V,Map>::shard_for(const K& key) {
+    return const_cast<shard&>(static_cast<const concurrent_hash_map&>(*this).shard_for(key));
+}
+
+template <typename K, typename V, typename Map>
+const typename concurrent_hash_map<K,V,Map>::shard& concurrent_hash_map<K,V,Map>::shard_for(const K& key) const {
+    // The low bits pick a bucket inside the shard, the top seven a hash_map
+    // fingerprint and the top byte an adaptive_hash_map bucket tag, so use
+    // none of them
+    return m_shards[(m_hasher(key) >> m_shard_shift) & (m_shard_count - 1)];
+}
+
+template <typename K, typename V, typename Map>
+void concurrent_hash_map<K,V,Map>::insert(const K& key, std::unique_ptr<V> value) {
+    shard& s = shard_for(key);
+    std::unique_lock<std::shared_mutex> lock(s.m_mutex);
+    s.m_map.insert(key, std::move(value));
+    s.m_size.store(s.m_map.size(), std::memory_order_relaxed);
+}
+
+template <typename K, typename V, typename Map>
+V concurrent_hash_map<K,V,Map>::peek(const K& key) const {
+    const shard& s = shard_for(key);
+    std::shared_lock<std::shared_mutex> lock(s.m_mutex);
+    // The const overload neither splays nor migrates, so readers may share it
+    return storage::deref(static_cast<const Map&>(s.m_map).peek(key));
+}
+
+template <typename K, typename V, typename Map>
+template <typename F>
+void concurrent_hash_map<K,V,Map>::visit(const K& key, F&& visitor) const {
+    const shard& s = shard_for(key);
+    std::shared_lock<std::shared_mutex> lock(s.m_mutex);
+    const V& value = storage::deref(static_cast<const Map&>(s.m_map).peek(key));
+    visitor(value);
+}
+
+template <typename K, typename V, typename Map>
+typename concurrent_hash_map<K,V,Map>::holder concurrent_hash_map<K,V,Map>::extract(const K& key) {
+    shard& s = shard_for(key);
+    std::unique_lock<std::shared_mutex> lock(s.m_mutex);
+    holder value = s.m_map.extract(key);
+    s.m_size.store(s.m_map.size(), std::memory_order_relaxed);
+    return value;
+}
+
+template <typename K, typename V, typename Map>
+size_t concurrent_hash_map<K,V,Map>::size() const {
+    size_t total = 0;
+    for (size_t i = 0; i < m_shard_count; i++) {
+        total += m_shards[i].m_size.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+template <typename K, typename V, typename Map>
+bool concurrent_hash_map<K,V,Map>::empty() const {
+    return size() == 0;
+}
+
+template <typename K, typename V, typename Map>
+size_t concurrent_hash_map<K,V,Map>::shard_count() const {
+    return m_shard_count;
+}
+
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <stdexcept>
+namespace cs251 {
+
+// Custom exception classes
+class duplicate_key : public std::runtime_error {
+	public: duplicate_key() : std::runtime_error("Duplicate key!") {} };
+class nonexistent_key : public std::runtime_error {
+	public: nonexistent_key() : std::runtime_error("Key does not exist!") {} };
+class empty_tree : public std::runtime_error {
+	public: empty_tree() : std::runtime_error("Tree is empty!") {} };
+
+}
@@ -1,51 +1,149 @@
 #pragma once
 #include <sstream>
+#include <stdexcept>
 #include <exception>
 #include <vector>
 #include <memory>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <algorithm>
+#include "probe_group.hpp"
+#include "hash_mix.hpp"
+#include "seeded_hash.hpp"
+#include "key_lookup.hpp"
+#include "exceptions.hpp"
+#include "value_storage.hpp"
 namespace cs251 {
 
-// Custom exception classes
-class duplicate_key : public std::runtime_error {
-	public: duplicate_key() : std::runtime_error("Duplicate key!") {} };
-class nonexistent_key : public std::runtime_error {
-	public: nonexistent_key() : std::runtime_error("Key does not exist!") {} };
-
-template <typename K, typename V>
+// Hash maps a key to a size_t; its low bits pick the home slot and its top
+// seven bits the fingerprint, so it must mix well, as mixed_hash does
+// With a reseedable Hash such as seeded_hash, an insert that lands
+// pathologically far from its home slot reseeds and rehashes the table
+// With CacheHash, every slot also keeps the full hash of its key, so moving
+// entries never calls the hasher again and a lookup compares keys only when
+// the whole hash matches; by default only keys that are costly to hash or
+// compare, such as strings, pay the extra word per slot
+// With InlineValue, slots hold V itself instead of a std::unique_ptr to it,
+// see value_storage.hpp and inline_hash_map below
+template <typename K, typename V, typename Hash = mixed_hash<K>, bool CacheHash = cache_hash_codes<K>::value,
+		bool InlineValue = false>
 class hash_map {
+	using storage = value_storage<V, InlineValue>;
 public:
-	class hash_map_node {
+	// The hasher type
+	using hasher = Hash;
+	// What a slot holds and extract returns: std::unique_ptr<V>, or V with InlineValue
+	using holder = typename storage::holder;
+	// What peek returns: const std::unique_ptr<V>&, or V& with InlineValue
+	using reference = typename storage::reference;
+	using const_reference = typename storage::const_reference;
+
+	class hash_map_node : public cached_hash<CacheHash> {
 	public:
 		// The key of current node.
 		K m_key = {};
 		// The value of current node.
-		std::unique_ptr<V> m_value{};
+		holder m_value{};
+	};
+
+	// Read-only view of the slot array, where an empty slot reads as nullptr
+	// While an incremental rehash is running, the slots of the table being
+	// drained follow those of the current table
+	class data_view {
+	public:
+		data_view(const hash_map& map) : m_map(map) {}
+		// Return the number of slots in the table
+		size_t size() const { return m_map.m_table.m_bucket_count + m_map.m_old.m_bucket_count; }
+		// Return a pointer to the node stored in slot index, or nullptr if it is empty
+		const hash_map_node* operator[](size_t index) const {
+			const table* t = &m_map.m_table;
+			if (index >= t->m_bucket_count) {
+				index -= t->m_bucket_count;
+				t = &m_map.m_old;
+			}
+			if (t->m_ctrl[index] == ctrl_empty) {
+				return nullptr;
+			}
+			return &t->m_data[index];
+		}
+	private:
+		const hash_map& m_map;
 	};
 
-	// Return a constant reference to the hash table vector
-	const std::vector<std::shared_ptr<hash_map_node>>& get_data() const;
+	// Return a view of the hash table slots
+	data_view get_data() const;
 
 	// Default constructor - create a hash map with an initial capacity of 1
 	hash_map();
-	// Constructor - create a hash map with an intial capacity of bucketCount
-	hash_map(size_t bucketCount);
+	// Constructor - create a hash map with an intial capacity of bucketCount,
+	// rounded up to a power of two
+	hash_map(size_t bucketCount, const Hash& hash = Hash());
 
 	// Get the hash code for a given key
-	size_t hash_code(K key) const;
+	size_t hash_code(const K& key) const;
 
-	// Change the size of the table to bucketCount, re-hashing all existing elements
+	// Change the size of the table to bucketCount rounded up to a power of
+	// two, re-hashing all existing elements
 	// bucketCount will never be 0 or less than the current number of elements
 	void resize(size_t bucketCount);
+	// Grow the table so that count elements fit without exceeding the maximum
+	// load factor, so a bulk load of count keys never resizes midway
+	// Extract never shrinks the table below the reserved capacity
+	void reserve(size_t count);
 
 	// Insert the key/value pair into the table, if the key doesn't already exist
 	// Throw duplicate_key if the key already exists
+	// With InlineValue the value is moved out of its pointer, which must not
+	// be null, and std::invalid_argument is thrown if it is
 	void insert(const K& key, std::unique_ptr<V> value);
-	// Return a const reference to the value associated with the given key
+	// Insert key with a value constructed from args, and return the value
+	// Throw duplicate_key if the key already exists
+	template <typename... Args>
+	V& emplace(const K& key, Args&&... args);
+	// Same as emplace, but if the key already exists return its value and
+	// false without constructing anything
+	// The pointer is null only for a null value inserted by pointer
+	template <typename... Args>
+	std::pair<V*, bool> try_emplace(const K& key, Args&&... args);
+	// Return a reference to the value associated with the given key, or to
+	// its pointer without InlineValue; the next insert or extract may move it
 	// Throw nonexistent_key if the key is not in the hash table
-	const std::unique_ptr<V>& peek(const K& key);
+	reference peek(const K& key);
+	// Same as peek, but never migrates entries of an incremental rehash, so
+	// concurrent readers may share the table as long as nothing modifies it
+	const_reference peek(const K& key) const;
 	// Remove and return the key-value pair associated with the given key
 	// Throw nonexistent_key if the key is not in the hash table
-	std::unique_ptr<V> extract(const K& key);
+	holder extract(const K& key);
+	// Same as peek and extract, for a key of another type Q that the hasher
+	// accepts and that compares equal to K with == (such as std::string_view
+	// for std::string keys), so no K has to be constructed for the lookup
+	template <typename Q, typename = std::enable_if_t<is_transparent_lookup<K,Hash,Q>::value>>
+	reference peek(const Q& key);
+	template <typename Q, typename = std::enable_if_t<is_transparent_lookup<K,Hash,Q>::value>>
+	const_reference peek(const Q& key) const;
+	template <typename Q, typename = std::enable_if_t<is_transparent_lookup<K,Hash,Q>::value>>
+	holder extract(const Q& key);
+
+	// Batched peek, insert and extract over a range of keys: each group of
+	// keys is hashed and has its home slots prefetched before any of them is
+	// probed, so the cache misses of a group overlap instead of queuing up
+	// Write to out, for each key in [first, last), a pointer to its value, or
+	// nullptr if the key is absent, and return the end of the output
+	template <typename ForwardIt, typename OutputIt>
+	OutputIt peek_batch(ForwardIt first, ForwardIt last, OutputIt out);
+	// Insert the key-value pairs in [first, last), moving each pair's second,
+	// a holder, into the table; room for all of them is reserved up front
+	// Throw duplicate_key at the first key that already exists, after
+	// inserting those before it; that pair and the ones after it keep their values
+	template <typename ForwardIt>
+	void insert_batch(ForwardIt first, ForwardIt last);
+	// Remove the keys in [first, last), writing their values to out in
+	// order, and return the end of the output
+	// Throw nonexistent_key at the first absent key, after extracting those before it
+	template <typename ForwardIt, typename OutputIt>
+	OutputIt extract_batch(ForwardIt first, ForwardIt last, OutputIt out);
 
 	// Return the current number of elements in the hash table
 	size_t size() const;
@@ -54,136 +152,665 @@ public:
 	// Return whether the hash table is currently empty
 	bool empty() const;
 
+	// Return the current number of elements per bucket
+	float load_factor() const;
+	// Return the load factor above which insert doubles the bucket count
+	float max_load_factor() const;
+	// Set the load factor above which insert doubles the bucket count
+	// A minimum load factor not below half the new maximum is lowered to a
+	// quarter of it, so a halved table never starts out ready to double
+	// Throw std::invalid_argument unless 0 < loadFactor <= 1
+	void max_load_factor(float loadFactor);
+	// Return the load factor below which extract halves the bucket count
+	float min_load_factor() const;
+	// Set the load factor below which extract halves the bucket count, or 0 to never shrink
+	// Throw std::invalid_argument unless 0 <= loadFactor < max_load_factor() / 2
+	void min_load_factor(float loadFactor);
+
+	// Return how many old slots each operation migrates during a load-factor
+	// triggered rehash, or 0 if such a rehash happens all at once
+	size_t incremental_rehash() const;
+	// Spread load-factor triggered rehashes over later operations, each one
+	// migrating at least slotsPerOperation old slots, or 0 to rehash all at once
+	// Lookups consult both tables until the migration completes
+	void incremental_rehash(size_t slotsPerOperation);
+	// Return whether an incremental rehash is currently migrating entries
+	bool rehashing() const;
+	// Return the fraction of the old table migrated so far, or 1 when idle
+	float rehash_progress() const;
+
 private:
-	// The array that holds key-value pairs
-	std::vector<std::shared_ptr<hash_map_node>> m_data = {};
-	// The bucket count of the array
-    size_t m_bucket_count = 0;
+	// Control byte marking a slot that holds no entry
+	static constexpr int8_t ctrl_empty = -128;
+	// Keys a batch operation hashes and prefetches ahead of probing them,
+	// enough to cover memory latency without evicting the lines it fetched
+	static constexpr size_t batch_group_size = 16;
+
+	// One open-addressing table; a second one only exists while an
+	// incremental rehash is draining it
+	struct table {
+		// The slot array that holds key-value pairs inline
+		std::vector<hash_map_node> m_data = {};
+		// One control byte per slot, either ctrl_empty or the fingerprint of the
+		// entry, followed by clones of the first max_group_width - 1 bytes so a
+		// group starting near the end wraps around without a bounds check
+		std::vector<int8_t> m_ctrl = {};
+		// The bucket count of the array, a power of two or 0
+		size_t m_bucket_count = 0;
+		// m_bucket_count - 1, masking a hash or a probe position into the array
+		size_t m_mask = 0;
+	};
+
+	// Return an empty table with bucketCount slots, a power of two
+	static table make_table(size_t bucketCount);
+	// Return the home slot in t of a key with the given hash
+	static size_t home_index(const table& t, size_t hash);
+	// Return the 7-bit fingerprint stored in the control byte of a key with the given hash
+	static int8_t fingerprint(size_t hash);
+	// Write the control byte for index, along with its clones past the end
+	static void set_ctrl(table& t, size_t index, int8_t value);
+	// Walk the probe sequence a group of control bytes at a time starting at
+	// the home slot of key, comparing full keys only where the fingerprint
+	// matches, and return the index holding key, or t.m_bucket_count if an
+	// empty slot is reached first
+	template <typename Q>
+	size_t find_index(const table& t, const Q& key, size_t hash) const;
+	// Bodies of peek and extract, shared by the K and heterogeneous overloads
+	template <typename Q>
+	const holder& peek_key(const Q& key) const;
+	template <typename Q>
+	holder extract_key(const Q& key, size_t hash);
+	// Return the value held in the current or old table for key, which has the
+	// given hash, or nullptr if the key is absent
+	holder* find_holder(const K& key, size_t hash);
+	// Insert key, which has the given hash and is absent, with value, and
+	// return the slot value
+	holder& insert_absent(const K& key, size_t hash, holder value);
+	// Prefetch the control bytes and slot where the probe sequence of a key
+	// with the given hash starts in the current table
+	void prefetch_home(size_t hash) const;
+	// Return the first empty slot at or after index, or t.m_bucket_count if
+	// the table is full
+	static size_t find_empty(const table& t, size_t index);
+	// Move node, whose key has the given hash, into the first empty slot of
+	// its probe sequence in t and return that slot
+	size_t place(table& t, hash_map_node&& node, size_t hash) const;
+	// Return the hash of the key held by node, cached or computed
+	size_t node_hash(const hash_map_node& node) const;
+	// Close the gap left at index by shifting later members of its probe run
+	// back towards their home slots, so no tombstones are needed
+	void backward_shift(table& t, size_t index) const;
+	// Double the bucket count until count elements stay within the maximum load factor
+	void grow_for(size_t count);
+	// Start moving every entry into a new table of bucketCount slots, all at
+	// once or incrementally depending on m_rehash_step
+	void begin_rehash(size_t bucketCount);
+	// Migrate at least slotCount old slots, stopping only at the end of a
+	// probe run so the entries left behind stay reachable
+	void migrate(size_t slotCount);
+	// Return the probe distance no insert should reach unless its keys were
+	// chosen to collide; random keys stay far below it at every table size
+	static size_t pathological_probe_length(size_t bucketCount);
+	// Pick a new seed and rehash every entry under it, all at once
+	void reseed();
+
+	// The hash function
+	Hash m_hasher {};
+	// The table that receives every insert
+	table m_table = {};
+	// The table being drained by an incremental rehash, empty otherwise
+	table m_old = {};
+	// The next slot of m_old to migrate
+	size_t m_migrate_index = 0;
+	// The number of slots of m_old migrated so far
+	size_t m_migrated = 0;
+	// Old slots migrated per operation, or 0 to rehash all at once
+	size_t m_rehash_step = 0;
+	// The number of reseeds so far, so batches notice when their hashes go stale
+	size_t m_reseeds = 0;
     // The size of the array
     size_t m_size = 0;
+    // Load factor above which the table grows
+    float m_max_load_factor = 0.875f;
+    // Load factor below which the table shrinks
+    float m_min_load_factor = 0.25f;
+    // The table never shrinks below the capacity it was constructed or reserved with
+    size_t m_min_bucket_count = 1;
 };
 
-template <typename K, typename V>
-const std::vector<std::shared_ptr<typename hash_map<K,V>::hash_map_node>>& hash_map<K,V>::get_data() const {
-	return m_data;
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+typename hash_map<K,V,Hash,CacheHash,InlineValue>::data_view hash_map<K,V,Hash,CacheHash,InlineValue>::get_data() const {
+	return data_view(*this);
 }
 
-template <typename K, typename V>hash_map<K,V>::hash_map() {
-    std::vector<std::shared_ptr<hash_map_node>> newTable(1);
-    m_data = std::move(newTable);
-	m_data[0] = nullptr;
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+hash_map<K,V,Hash,CacheHash,InlineValue>::hash_map() {
+    m_table = make_table(1);
     m_size = 0;
-    m_bucket_count = 1;
 }
 
-template <typename K, typename V>
-hash_map<K,V>::hash_map(const size_t bucketCount) {
-    std::vector<std::shared_ptr<hash_map_node>> newTable(bucketCount);
-    m_data = std::move(newTable);
-	for (int i = 0; i < bucketCount; i++) {
-        m_data[i] = nullptr;    
-    }
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+hash_map<K,V,Hash,CacheHash,InlineValue>::hash_map(const size_t bucketCount, const Hash& hash) : m_hasher(hash) {
+    m_table = make_table(next_power_of_two(bucketCount));
     m_size = 0;
-    m_bucket_count = bucketCount;
+    m_min_bucket_count = m_table.m_bucket_count;
 }
 
-template <typename K, typename V>
-size_t hash_map<K,V>::hash_code(K key) const {
-	return key % m_bucket_count;
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+size_t hash_map<K,V,Hash,CacheHash,InlineValue>::hash_code(const K& key) const {
+	return home_index(m_table, m_hasher(key));
 }
 
-template <typename K, typename V>
-void hash_map<K,V>::resize(const size_t bucketCount) {
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+void hash_map<K,V,Hash,CacheHash,InlineValue>::resize(const size_t bucketCount) {
 	if (bucketCount < m_size) {
-        return;    
-    }
-    size_t oldBucketCount = m_bucket_count;
-    m_bucket_count = bucketCount;
-    std::vector<std::shared_ptr<hash_map_node>> newTable(bucketCount);
-    for (int i = 0; i < oldBucketCount; i++) {
-        if (m_data[i] != nullptr) {
-            size_t index = hash_code(m_data[i]->m_key);
-            while (newTable[index] != nullptr) {
-                index = (index + 1) % m_bucket_count;    
-            }
-            newTable[index] = m_data[i];
+        return;
+    }
+    // An explicit resize always completes before returning
+    size_t rehashStep = m_rehash_step;
+    m_rehash_step = 0;
+    begin_rehash(next_power_of_two(bucketCount));
+    m_rehash_step = rehashStep;
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+void hash_map<K,V,Hash,CacheHash,InlineValue>::reserve(size_t count) {
+    grow_for(count);
+    // Raise the shrink floor so churn after a presize doesn't halve the table
+    size_t bucketCount = 1;
+    while (count > m_max_load_factor * bucketCount) {
+        bucketCount *= 2;
+    }
+    m_min_bucket_count = std::max(m_min_bucket_count, bucketCount);
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+typename hash_map<K,V,Hash,CacheHash,InlineValue>::table hash_map<K,V,Hash,CacheHash,InlineValue>::make_table(size_t bucketCount) {
+    table t;
+    t.m_data = std::vector<hash_map_node>(bucketCount);
+    t.m_ctrl = std::vector<int8_t>(bucketCount + max_group_width - 1, ctrl_empty);
+    t.m_bucket_count = bucketCount;
+    t.m_mask = bucketCount - 1;
+    return t;
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+size_t hash_map<K,V,Hash,CacheHash,InlineValue>::home_index(const table& t, size_t hash) {
+    return hash & t.m_mask;
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+void hash_map<K,V,Hash,CacheHash,InlineValue>::grow_for(size_t count) {
+    size_t bucketCount = m_table.m_bucket_count;
+    while (count > m_max_load_factor * bucketCount) {
+        bucketCount *= 2;
+    }
+    if (bucketCount != m_table.m_bucket_count) {
+        begin_rehash(bucketCount);
+    }
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+void hash_map<K,V,Hash,CacheHash,InlineValue>::begin_rehash(size_t bucketCount) {
+    // Only one old table is kept, so finish any migration still running
+    migrate(m_old.m_bucket_count);
+    m_old = std::move(m_table);
+    m_table = make_table(bucketCount);
+    // Start right after an empty slot so migration never splits a probe run
+    size_t start = find_empty(m_old, 0);
+    m_migrate_index = start == m_old.m_bucket_count ? 0 : start;
+    m_migrated = 0;
+    migrate(m_rehash_step == 0 ? m_old.m_bucket_count : m_rehash_step);
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+void hash_map<K,V,Hash,CacheHash,InlineValue>::migrate(size_t slotCount) {
+    if (m_old.m_bucket_count == 0) {
+        return;
+    }
+    size_t visited = 0;
+    while (m_migrated < m_old.m_bucket_count
+            && (visited < slotCount || m_old.m_ctrl[m_migrate_index] != ctrl_empty)) {
+        if (m_old.m_ctrl[m_migrate_index] != ctrl_empty) {
+            hash_map_node& node = m_old.m_data[m_migrate_index];
+            place(m_table, std::move(node), node_hash(node));
+            set_ctrl(m_old, m_migrate_index, ctrl_empty);
         }
+        m_migrate_index = (m_migrate_index + 1) & m_old.m_mask;
+        m_migrated++;
+        visited++;
+    }
+    if (m_migrated == m_old.m_bucket_count) {
+        m_old = table();
+        m_migrated = 0;
+        m_migrate_index = 0;
     }
-    m_data = std::move(newTable);
 }
 
-template <typename K, typename V>
-void hash_map<K,V>::insert(const K& key, std::unique_ptr<V> value) {
-    for (int i = 0; i < m_bucket_count; i++) {
-        if (m_data[i] != nullptr) {
-            if (m_data[i]->m_key == key) {
-                throw duplicate_key();    
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+int8_t hash_map<K,V,Hash,CacheHash,InlineValue>::fingerprint(size_t hash) {
+    // The top bits, independent of the low bits that pick the home slot
+    return static_cast<int8_t>(hash >> (sizeof(size_t) * 8 - 7));
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+void hash_map<K,V,Hash,CacheHash,InlineValue>::set_ctrl(table& t, size_t index, int8_t value) {
+    for (size_t i = index; i < t.m_ctrl.size(); i += t.m_bucket_count) {
+        t.m_ctrl[i] = value;
+    }
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+template <typename Q>
+size_t hash_map<K,V,Hash,CacheHash,InlineValue>::find_index(const table& t, const Q& key, size_t hash) const {
+    if (t.m_bucket_count == 0) {
+        return 0;
+    }
+    const probe_group& group = active_probe_group();
+    int8_t tag = fingerprint(hash);
+    size_t index = home_index(t, hash);
+    for (size_t probed = 0; probed < t.m_bucket_count; probed += group.m_width) {
+        const int8_t* ctrl = &t.m_ctrl[index];
+        uint32_t matches = group.m_match(ctrl, tag);
+        uint32_t empties = group.m_match(ctrl, ctrl_empty);
+        if (empties != 0) {
+            // Slots past the first empty one belong to other probe runs
+            matches &= (empties & (~empties + 1)) - 1;
+        }
+        while (matches != 0) {
+            size_t slot = (index + lowest_match(matches)) & t.m_mask;
+            const hash_map_node& node = t.m_data[slot];
+            bool hashMatches = true;
+            if constexpr (CacheHash) {
+                hashMatches = node.m_hash == hash;
             }
+            if (hashMatches && node.m_key == key) {
+                return slot;
+            }
+            matches &= matches - 1;
+        }
+        if (empties != 0) {
+            break;
         }
+        index = (index + group.m_width) & t.m_mask;
     }
-	size_t startIndex = hash_code(key);
-    size_t index = startIndex;
-    while (m_data[index] != nullptr) {
-        index = (index + 1) % m_bucket_count;
-        if (index == startIndex) {
-            resize(2 * m_bucket_count);
-            startIndex = hash_code(key);
-            index = startIndex;
+    return t.m_bucket_count;
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+size_t hash_map<K,V,Hash,CacheHash,InlineValue>::find_empty(const table& t, size_t index) {
+    const probe_group& group = active_probe_group();
+    for (size_t probed = 0; probed < t.m_bucket_count; probed += group.m_width) {
+        uint32_t empties = group.m_match(&t.m_ctrl[index], ctrl_empty);
+        if (empties != 0) {
+            return (index + lowest_match(empties)) & t.m_mask;
         }
+        index = (index + group.m_width) & t.m_mask;
     }
-    m_data[index] = std::make_shared<hash_map_node>();
-    m_data[index]->m_key = key;
-    m_data[index]->m_value = std::move(value);
-    m_size++;
+    return t.m_bucket_count;
 }
 
-template <typename K, typename V>
-const std::unique_ptr<V>& hash_map<K,V>::peek(const K& key) {
-	for (int i = 0; i < m_bucket_count; i++) {
-        if (m_data[i] != nullptr) {
-            if (m_data[i]->m_key == key) {
-                return m_data[i]->m_value;    
-            }
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+size_t hash_map<K,V,Hash,CacheHash,InlineValue>::place(table& t, hash_map_node&& node, size_t hash) const {
+    size_t index = find_empty(t, home_index(t, hash));
+    t.m_data[index] = std::move(node);
+    if constexpr (CacheHash) {
+        t.m_data[index].m_hash = hash;
+    }
+    set_ctrl(t, index, fingerprint(hash));
+    return index;
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+size_t hash_map<K,V,Hash,CacheHash,InlineValue>::node_hash(const hash_map_node& node) const {
+    if constexpr (CacheHash) {
+        return node.m_hash;
+    } else {
+        return m_hasher(node.m_key);
+    }
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+size_t hash_map<K,V,Hash,CacheHash,InlineValue>::pathological_probe_length(size_t bucketCount) {
+    // Random keys at the maximum load factor of 0.875 stay below about
+    // 800 slots even with millions of slots
+    return 128 * (floor_log2(bucketCount) + 1);
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+void hash_map<K,V,Hash,CacheHash,InlineValue>::reseed() {
+    // Entries still in the old table were placed under the old seed, and
+    // cached hashes are recomputed rather than reused
+    migrate(m_old.m_bucket_count);
+    m_hasher.reseed();
+    m_reseeds++;
+    table old = std::move(m_table);
+    m_table = make_table(old.m_bucket_count);
+    for (size_t i = 0; i < old.m_bucket_count; i++) {
+        if (old.m_ctrl[i] != ctrl_empty) {
+            place(m_table, std::move(old.m_data[i]), m_hasher(old.m_data[i].m_key));
         }
     }
-    throw nonexistent_key();
 }
 
-template <typename K, typename V>
-std::unique_ptr<V> hash_map<K,V>::extract(const K& key) {
-	int index = -1;
-    for (int i = 0; i < m_bucket_count; i++) {
-        if (m_data[i] != nullptr) {
-            if (m_data[i]->m_key == key) {
-                index = i;    
-            }
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+void hash_map<K,V,Hash,CacheHash,InlineValue>::backward_shift(table& t, size_t index) const {
+    size_t hole = index;
+    size_t next = (hole + 1) & t.m_mask;
+    set_ctrl(t, hole, ctrl_empty);
+    while (t.m_ctrl[next] != ctrl_empty) {
+        // An entry may only move back if the hole is not before its home slot
+        size_t home = home_index(t, node_hash(t.m_data[next]));
+        size_t distanceFromHome = (next - home) & t.m_mask;
+        size_t distanceFromHole = (next - hole) & t.m_mask;
+        if (distanceFromHome >= distanceFromHole) {
+            t.m_data[hole] = std::move(t.m_data[next]);
+            set_ctrl(t, hole, t.m_ctrl[next]);
+            set_ctrl(t, next, ctrl_empty);
+            hole = next;
+        }
+        next = (next + 1) & t.m_mask;
+    }
+    // Release whatever the vacated slot still owns
+    t.m_data[hole] = hash_map_node();
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+void hash_map<K,V,Hash,CacheHash,InlineValue>::insert(const K& key, std::unique_ptr<V> value) {
+    migrate(m_rehash_step);
+    size_t hash = m_hasher(key);
+	if (find_holder(key, hash) != nullptr) {
+        throw duplicate_key();
+    }
+    insert_absent(key, hash, storage::from_pointer(std::move(value)));
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+template <typename... Args>
+V& hash_map<K,V,Hash,CacheHash,InlineValue>::emplace(const K& key, Args&&... args) {
+    migrate(m_rehash_step);
+    size_t hash = m_hasher(key);
+    if (find_holder(key, hash) != nullptr) {
+        throw duplicate_key();
+    }
+    return *storage::get(insert_absent(key, hash, storage::make(std::forward<Args>(args)...)));
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+template <typename... Args>
+std::pair<V*, bool> hash_map<K,V,Hash,CacheHash,InlineValue>::try_emplace(const K& key, Args&&... args) {
+    migrate(m_rehash_step);
+    size_t hash = m_hasher(key);
+    holder* existing = find_holder(key, hash);
+    if (existing != nullptr) {
+        return { storage::get(*existing), false };
+    }
+    return { storage::get(insert_absent(key, hash, storage::make(std::forward<Args>(args)...))), true };
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+typename hash_map<K,V,Hash,CacheHash,InlineValue>::holder* hash_map<K,V,Hash,CacheHash,InlineValue>::find_holder(
+        const K& key, size_t hash) {
+    size_t index = find_index(m_table, key, hash);
+    if (index != m_table.m_bucket_count) {
+        return &m_table.m_data[index].m_value;
+    }
+    index = find_index(m_old, key, hash);
+    if (index != m_old.m_bucket_count) {
+        return &m_old.m_data[index].m_value;
+    }
+    return nullptr;
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+typename hash_map<K,V,Hash,CacheHash,InlineValue>::holder& hash_map<K,V,Hash,CacheHash,InlineValue>::insert_absent(
+        const K& key, size_t hash, holder value) {
+    grow_for(m_size + 1);
+    hash_map_node node;
+    node.m_key = key;
+    node.m_value = std::move(value);
+    size_t index = place(m_table, std::move(node), hash);
+    m_size++;
+    if constexpr (is_reseedable<Hash>::value) {
+        if (((index - home_index(m_table, hash)) & m_table.m_mask) > pathological_probe_length(m_table.m_bucket_count)) {
+            reseed();
+            hash = m_hasher(key);
+            index = find_index(m_table, key, hash);
         }
     }
-    if (index == -1) {
-        throw nonexistent_key();    
+    return m_table.m_data[index].m_value;
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+typename hash_map<K,V,Hash,CacheHash,InlineValue>::reference hash_map<K,V,Hash,CacheHash,InlineValue>::peek(const K& key) {
+    migrate(m_rehash_step);
+    return const_cast<holder&>(peek_key(key));
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+typename hash_map<K,V,Hash,CacheHash,InlineValue>::const_reference hash_map<K,V,Hash,CacheHash,InlineValue>::peek(const K& key) const {
+    return peek_key(key);
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+typename hash_map<K,V,Hash,CacheHash,InlineValue>::holder hash_map<K,V,Hash,CacheHash,InlineValue>::extract(const K& key) {
+    return extract_key(key, m_hasher(key));
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+template <typename Q, typename>
+typename hash_map<K,V,Hash,CacheHash,InlineValue>::reference hash_map<K,V,Hash,CacheHash,InlineValue>::peek(const Q& key) {
+    migrate(m_rehash_step);
+    return const_cast<holder&>(peek_key(key));
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+template <typename Q, typename>
+typename hash_map<K,V,Hash,CacheHash,InlineValue>::const_reference hash_map<K,V,Hash,CacheHash,InlineValue>::peek(const Q& key) const {
+    return peek_key(key);
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+template <typename Q, typename>
+typename hash_map<K,V,Hash,CacheHash,InlineValue>::holder hash_map<K,V,Hash,CacheHash,InlineValue>::extract(const Q& key) {
+    return extract_key(key, m_hasher(key));
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+template <typename Q>
+const typename hash_map<K,V,Hash,CacheHash,InlineValue>::holder& hash_map<K,V,Hash,CacheHash,InlineValue>::peek_key(const Q& key) const {
+    size_t hash = m_hasher(key);
+	size_t index = find_index(m_table, key, hash);
+    if (index != m_table.m_bucket_count) {
+        return m_table.m_data[index].m_value;
+    }
+    index = find_index(m_old, key, hash);
+    if (index != m_old.m_bucket_count) {
+        return m_old.m_data[index].m_value;
     }
-    std::unique_ptr<V> value = std::move(m_data[index]->m_value);
-    m_data[index] = nullptr;
+    throw nonexistent_key();
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+template <typename Q>
+typename hash_map<K,V,Hash,CacheHash,InlineValue>::holder hash_map<K,V,Hash,CacheHash,InlineValue>::extract_key(const Q& key, size_t hash) {
+    migrate(m_rehash_step);
+    table* t = &m_table;
+	size_t index = find_index(*t, key, hash);
+    if (index == t->m_bucket_count) {
+        t = &m_old;
+        index = find_index(*t, key, hash);
+        if (index == t->m_bucket_count) {
+            throw nonexistent_key();
+        }
+    }
+    holder value = std::move(t->m_data[index].m_value);
+    backward_shift(*t, index);
     m_size--;
+    size_t bucketCount = m_table.m_bucket_count;
+    if (bucketCount / 2 >= m_min_bucket_count && m_size < m_min_load_factor * bucketCount) {
+        begin_rehash(bucketCount / 2);
+    }
     return value;
 }
 
-template <typename K, typename V>
-size_t hash_map<K,V>::size() const {
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+void hash_map<K,V,Hash,CacheHash,InlineValue>::prefetch_home(size_t hash) const {
+    size_t index = home_index(m_table, hash);
+    prefetch(&m_table.m_ctrl[index]);
+    prefetch(&m_table.m_data[index]);
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+template <typename ForwardIt, typename OutputIt>
+OutputIt hash_map<K,V,Hash,CacheHash,InlineValue>::peek_batch(ForwardIt first, ForwardIt last, OutputIt out) {
+    ForwardIt keys[batch_group_size];
+    size_t hashes[batch_group_size];
+    while (first != last) {
+        migrate(m_rehash_step);
+        size_t count = 0;
+        for (; count < batch_group_size && first != last; ++first, ++count) {
+            keys[count] = first;
+            hashes[count] = m_hasher(*first);
+            prefetch_home(hashes[count]);
+        }
+        for (size_t i = 0; i < count; i++) {
+            holder* value = find_holder(*keys[i], hashes[i]);
+            *out++ = value == nullptr ? nullptr : storage::get(*value);
+        }
+    }
+    return out;
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+template <typename ForwardIt>
+void hash_map<K,V,Hash,CacheHash,InlineValue>::insert_batch(ForwardIt first, ForwardIt last) {
+    // Growing now keeps the table, and so the prefetched slots, in place
+    grow_for(m_size + static_cast<size_t>(std::distance(first, last)));
+    ForwardIt pairs[batch_group_size];
+    size_t hashes[batch_group_size];
+    while (first != last) {
+        size_t reseeds = m_reseeds;
+        size_t count = 0;
+        for (; count < batch_group_size && first != last; ++first, ++count) {
+            pairs[count] = first;
+            hashes[count] = m_hasher(first->first);
+            prefetch_home(hashes[count]);
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (m_reseeds != reseeds) {
+                // An insert of this group reseeded, so the hashes computed before are stale
+                hashes[i] = m_hasher(pairs[i]->first);
+            }
+            migrate(m_rehash_step);
+            if (find_holder(pairs[i]->first, hashes[i]) != nullptr) {
+                throw duplicate_key();
+            }
+            insert_absent(pairs[i]->first, hashes[i], std::move(pairs[i]->second));
+        }
+    }
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+template <typename ForwardIt, typename OutputIt>
+OutputIt hash_map<K,V,Hash,CacheHash,InlineValue>::extract_batch(ForwardIt first, ForwardIt last, OutputIt out) {
+    ForwardIt keys[batch_group_size];
+    size_t hashes[batch_group_size];
+    while (first != last) {
+        size_t count = 0;
+        for (; count < batch_group_size && first != last; ++first, ++count) {
+            keys[count] = first;
+            hashes[count] = m_hasher(*first);
+            prefetch_home(hashes[count]);
+        }
+        for (size_t i = 0; i < count; i++) {
+            *out++ = extract_key(*keys[i], hashes[i]);
+        }
+    }
+    return out;
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+size_t hash_map<K,V,Hash,CacheHash,InlineValue>::size() const {
 	return m_size;
 }
 
-template <typename K, typename V>
-size_t hash_map<K,V>::bucket_count() const {
-	return m_bucket_count;
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+size_t hash_map<K,V,Hash,CacheHash,InlineValue>::bucket_count() const {
+	return m_table.m_bucket_count;
 }
 
-template <typename K, typename V>
-bool hash_map<K,V>::empty() const {
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+bool hash_map<K,V,Hash,CacheHash,InlineValue>::empty() const {
 	if (m_size == 0) {
-        return true;    
+        return true;
     }
     return false;
 }
 
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+float hash_map<K,V,Hash,CacheHash,InlineValue>::load_factor() const {
+    return static_cast<float>(m_size) / m_table.m_bucket_count;
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+float hash_map<K,V,Hash,CacheHash,InlineValue>::max_load_factor() const {
+    return m_max_load_factor;
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+void hash_map<K,V,Hash,CacheHash,InlineValue>::max_load_factor(float loadFactor) {
+    if (!(loadFactor > 0.0f && loadFactor <= 1.0f)) {
+        throw std::invalid_argument("Invalid maximum load factor!");
+    }
+    m_max_load_factor = loadFactor;
+    if (m_min_load_factor >= loadFactor / 2) {
+        m_min_load_factor = loadFactor / 4;
+    }
+    grow_for(m_size);
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+float hash_map<K,V,Hash,CacheHash,InlineValue>::min_load_factor() const {
+    return m_min_load_factor;
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+void hash_map<K,V,Hash,CacheHash,InlineValue>::min_load_factor(float loadFactor) {
+    if (!(loadFactor >= 0.0f && loadFactor < m_max_load_factor / 2)) {
+        throw std::invalid_argument("Invalid minimum load factor!");
+    }
+    m_min_load_factor = loadFactor;
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+size_t hash_map<K,V,Hash,CacheHash,InlineValue>::incremental_rehash() const {
+    return m_rehash_step;
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+void hash_map<K,V,Hash,CacheHash,InlineValue>::incremental_rehash(size_t slotsPerOperation) {
+    m_rehash_step = slotsPerOperation;
+    if (m_rehash_step == 0) {
+        migrate(m_old.m_bucket_count);
+    }
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+bool hash_map<K,V,Hash,CacheHash,InlineValue>::rehashing() const {
+    return m_old.m_bucket_count != 0;
+}
+
+template <typename K, typename V, typename Hash, bool CacheHash, bool InlineValue>
+float hash_map<K,V,Hash,CacheHash,InlineValue>::rehash_progress() const {
+    if (m_old.m_bucket_count == 0) {
+        return 1.0f;
+    }
+    return static_cast<float>(m_migrated) / m_old.m_bucket_count;
+}
+
+// hash_map whose slots hold values inline, for small values such as numbers
+template <typename K, typename V, typename Hash = mixed_hash<K>>
+using inline_hash_map = hash_map<K, V, Hash, cache_hash_codes<K>::value, true>;
+
 }
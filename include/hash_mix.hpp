@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+namespace cs251 {
+
+// Scramble h so every input bit affects every output bit (the MurmurHash3
+// 64-bit finalizer), turning identity-like hashes such as std::hash<int>
+// into ones whose low bits can index a power-of-two table directly
+inline uint64_t mix_hash(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+// Combine the hash of one more field into seed; the order of the fields
+// matters, so swapped or equal fields no longer cancel out
+inline size_t hash_combine(size_t seed, size_t value) {
+    return static_cast<size_t>(mix_hash(mix_hash(seed) ^ value));
+}
+
+// Default hasher of the hash containers: std::hash followed by mix_hash
+// Transparent, so lookups may pass a key view Q whose std::hash agrees with
+// std::hash<K>, as std::string_view does for std::string
+template <typename K>
+struct mixed_hash {
+	using is_transparent = void;
+
+	size_t operator()(const K& key) const {
+		return static_cast<size_t>(mix_hash(static_cast<uint64_t>(std::hash<K>{}(key))));
+	}
+	template <typename Q>
+	size_t operator()(const Q& key) const {
+		return static_cast<size_t>(mix_hash(static_cast<uint64_t>(std::hash<Q>{}(key))));
+	}
+};
+
+// Return the smallest power of two that is at least count, and at least 1
+inline size_t next_power_of_two(size_t count) {
+    size_t power = 1;
+    while (power < count) {
+        power *= 2;
+    }
+    return power;
+}
+
+// Whether containers keep each key's full hash code next to it by default:
+// worth a word per entry unless hashing the key costs no more than loading it
+template <typename K>
+struct cache_hash_codes
+	: std::bool_constant<!std::is_arithmetic_v<K> && !std::is_enum_v<K> && !std::is_pointer_v<K>> {};
+
+// Full hash code stored in a container node, present only when the
+// container caches hash codes
+template <bool Enabled>
+struct cached_hash {
+	// The hash of the node's key under the container's current hasher
+	size_t m_hash = 0;
+};
+template <>
+struct cached_hash<false> {};
+
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <thread>
+namespace cs251 {
+
+// Hazard pointers for safe memory reclamation
+// A reader publishes each pointer it is about to dereference in a record it
+// owns, then checks that the pointer is still reachable before using it
+// A writer that has unlinked an object frees it only once no record holds
+// the object, so it defers on, or waits for, the readers of that one object
+// instead of every reader
+class hazard_domain {
+	struct record;
+public:
+	// Number of pointers one record protects at a time
+	static constexpr size_t pointers_per_record = 2;
+
+	// A record owned by the calling thread until destroyed, which clears it
+	class guard {
+	public:
+		explicit guard(const hazard_domain& domain);
+		~guard();
+		guard(const guard&) = delete;
+		guard& operator=(const guard&) = delete;
+
+		// Publish pointer in slot index; it is only safe to use once the
+		// caller has seen it still reachable after this call
+		void protect(size_t index, const void* pointer);
+		// Publish the pointer held by source in slot index and return it,
+		// retrying until source still holds it after the publication
+		template <typename T>
+		T* protect(size_t index, const std::atomic<T*>& source);
+	private:
+		record* m_record;
+	};
+
+	hazard_domain() = default;
+	hazard_domain(const hazard_domain&) = delete;
+	hazard_domain& operator=(const hazard_domain&) = delete;
+
+	// Take a record for the calling thread; up to record_count threads hold
+	// one at once without waiting, more spin until a record is released
+	guard acquire() const { return guard(*this); }
+	// Return whether any record currently protects pointer
+	bool is_protected(const void* pointer) const;
+	// Wait until no record protects pointer; the pointer must already be
+	// unreachable, so no new reader can come to protect it
+	void wait_unprotected(const void* pointer) const;
+
+private:
+	// Number of records that reading threads spread over
+	static constexpr size_t record_count = 64;
+
+	// One cache line per record, so readers never share lines
+	struct alignas(64) record {
+		std::atomic<bool> m_owned{false};
+		std::atomic<const void*> m_pointers[pointers_per_record] = {};
+	};
+
+	// Return the record the calling thread tries first
+	static size_t first_record();
+
+	mutable record m_records[record_count];
+};
+
+inline hazard_domain::guard::guard(const hazard_domain& domain) {
+    for (size_t i = first_record(); ; i = (i + 1) % record_count) {
+        record& r = domain.m_records[i];
+        if (!r.m_owned.load(std::memory_order_relaxed) && !r.m_owned.exchange(true, std::memory_order_acquire)) {
+            m_record = &r;
+            return;
+        }
+        if (i + 1 == record_count) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+inline hazard_domain::guard::~guard() {
+    for (std::atomic<const void*>& pointer : m_record->m_pointers) {
+        pointer.store(nullptr, std::memory_order_release);
+    }
+    m_record->m_owned.store(false, std::memory_order_release);
+}
+
+inline void hazard_domain::guard::protect(size_t index, const void* pointer) {
+    // Sequentially consistent, so a writer that unlinks the pointer and then
+    // scans either sees this store or has unlinked it before our re-check
+    m_record->m_pointers[index].store(pointer);
+}
+
+template <typename T>
+T* hazard_domain::guard::protect(size_t index, const std::atomic<T*>& source) {
+    T* pointer = source.load();
+    for (;;) {
+        protect(index, pointer);
+        T* current = source.load();
+        if (current == pointer) {
+            return pointer;
+        }
+        pointer = current;
+    }
+}
+
+inline bool hazard_domain::is_protected(const void* pointer) const {
+    for (const record& r : m_records) {
+        for (const std::atomic<const void*>& hazard : r.m_pointers) {
+            if (hazard.load() == pointer) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+inline void hazard_domain::wait_unprotected(const void* pointer) const {
+    while (is_protected(pointer)) {
+        std::this_thread::yield();
+    }
+}
+
+inline size_t hazard_domain::first_record() {
+    static thread_local const size_t index = std::hash<std::thread::id>{}(std::this_thread::get_id()) % record_count;
+    return index;
+}
+
+}
@@ -0,0 +1,367 @@
+#pragma once
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include "exceptions.hpp"
+#include "probe_group.hpp"
+namespace cs251 {
+
+// Bucket of an adaptive_hash_map. Up to small_bucket_size entries are kept
+// inline, as pointers to their nodes next to the top byte of each one's
+// hash, so a lookup in a small bucket reads the bucket and only the node
+// whose hash byte matches; a bucket outgrowing that moves its nodes into a
+// Tree, a splay_tree, and a tree shrinking to demotion_size entries moves
+// them back
+// Nodes are created in an arena shared with the other buckets either way,
+// so they never move, and inline nodes are never linked to each other
+// Buckets keep no pointer to the arena, leaving room for one more inline
+// entry in 40 bytes, so operations that create a tree or destroy a node
+// take it, and the owner must destroy the nodes of a bucket before the
+// bucket itself, as node_arena asks of its owners
+template <typename Tree>
+class hybrid_bucket {
+public:
+	// The node, arena and holder types of the tree
+	using splay_tree_node = typename Tree::splay_tree_node;
+	using arena_type = typename Tree::arena_type;
+	using holder = typename Tree::holder;
+
+	// Most entries a bucket keeps inline
+	static constexpr size_t small_bucket_size = 4;
+	// Size at which a tree turns back into inline entries, below
+	// small_bucket_size so a bucket at the threshold doesn't convert back
+	// and forth on every insert and extract
+	static constexpr size_t demotion_size = small_bucket_size - 1;
+
+	// Create an empty bucket
+	hybrid_bucket() = default;
+	// Buckets hold their nodes, so they can be moved, leaving the source
+	// empty, or swapped, but not copied
+	hybrid_bucket(hybrid_bucket&& other) noexcept;
+	hybrid_bucket(const hybrid_bucket&) = delete;
+	hybrid_bucket& operator=(const hybrid_bucket&) = delete;
+	void swap(hybrid_bucket& other) noexcept;
+	// Destroy every node, inline ones in arena, and leave the bucket empty
+	void destroy_nodes(arena_type& arena);
+
+	// Return whether the bucket holds no entries
+	bool empty() const;
+	// Return the number of entries in the bucket
+	size_t size() const;
+	// Return whether the entries are in a tree rather than inline
+	bool promoted() const;
+	// Return the root of a promoted bucket's tree, or nullptr while the
+	// entries are inline
+	const splay_tree_node* get_root() const;
+	// Call visit with each inline node, in the order they arrived; a
+	// promoted bucket has none
+	template <typename F>
+	void for_each_inline(F&& visit) const;
+	// Prefetch the node a lookup of a key with the given hash reads first:
+	// the tree's root, or the inline node whose hash byte matches
+	void prefetch_node(size_t hash) const;
+
+	// Return the node holding key, which has the given hash, or nullptr;
+	// a tree restructures as its policy directs, unless the bucket is const
+	template <typename Q>
+	splay_tree_node* find_node(const Q& key, size_t hash);
+	template <typename Q>
+	const splay_tree_node* find_node(const Q& key, size_t hash) const;
+	// Link node, created in arena, whose key has the given hash
+	// Throw duplicate_key if its key already exists, leaving the node with the caller
+	void insert_node(splay_tree_node* node, size_t hash, arena_type& arena);
+	// Same as splay_tree::insert_sorted_nodes, for count nodes created in
+	// arena and sorted by key, whose keys have the given hashes
+	void insert_sorted_nodes(splay_tree_node* const* nodes, const size_t* hashes, size_t count, arena_type& arena);
+	// Remove the node holding key, which has the given hash, destroying it
+	// in arena, and return its value
+	// nodeHash(node) returns the hash of a node's key, for the entries a
+	// shrinking tree moves back inline
+	// Throw nonexistent_key if the key is not in the bucket
+	template <typename Q, typename NodeHash>
+	holder extract(const Q& key, size_t hash, arena_type& arena, NodeHash&& nodeHash);
+	// Detach every node, passing each one to release in key order, and
+	// leave the bucket empty
+	template <typename F>
+	void release_nodes(F&& release);
+
+private:
+	// m_count of a promoted bucket
+	static constexpr unsigned char promoted_count = std::numeric_limits<unsigned char>::max();
+
+	// Move the entries of other into this bucket, which is empty, and leave other empty
+	void take(hybrid_bucket& other) noexcept;
+	// Return the byte of hash kept inline; the top one, as the low bits all
+	// agree within a bucket
+	static unsigned char hash_tag(size_t hash);
+	// Append node to the inline entries, of which there are fewer than small_bucket_size
+	void add_inline(splay_tree_node* node, size_t hash);
+	// Move the inline nodes into a new tree creating nodes in arena
+	// The tree is built before the bucket changes, so if it cannot be
+	// allocated the bucket keeps its inline nodes
+	void promote(arena_type& arena);
+	// Move the nodes of the tree back inline and free it
+	template <typename NodeHash>
+	void demote(NodeHash&& nodeHash);
+
+	union {
+		// The inline nodes, in the order they arrived
+		splay_tree_node* m_nodes[small_bucket_size] {};
+		// The tree of a promoted bucket
+		Tree* m_tree;
+	};
+	// hash_tag of the key of each inline node
+	unsigned char m_tags[small_bucket_size] {};
+	// Number of inline nodes, or promoted_count
+	unsigned char m_count = 0;
+};
+
+template <typename Tree>
+hybrid_bucket<Tree>::hybrid_bucket(hybrid_bucket&& other) noexcept {
+    take(other);
+}
+
+template <typename Tree>
+void hybrid_bucket<Tree>::swap(hybrid_bucket& other) noexcept {
+    hybrid_bucket moved(std::move(other));
+    other.take(*this);
+    take(moved);
+}
+
+template <typename Tree>
+void hybrid_bucket<Tree>::destroy_nodes(arena_type& arena) {
+    if (promoted()) {
+        delete m_tree;
+    } else {
+        for (size_t i = 0; i < m_count; i++) {
+            arena.destroy(m_nodes[i]);
+        }
+    }
+    m_count = 0;
+}
+
+template <typename Tree>
+bool hybrid_bucket<Tree>::empty() const {
+    return promoted() ? m_tree->empty() : m_count == 0;
+}
+
+template <typename Tree>
+size_t hybrid_bucket<Tree>::size() const {
+    return promoted() ? m_tree->size() : m_count;
+}
+
+template <typename Tree>
+bool hybrid_bucket<Tree>::promoted() const {
+    return m_count == promoted_count;
+}
+
+template <typename Tree>
+const typename hybrid_bucket<Tree>::splay_tree_node* hybrid_bucket<Tree>::get_root() const {
+    return promoted() ? m_tree->get_root() : nullptr;
+}
+
+template <typename Tree>
+template <typename F>
+void hybrid_bucket<Tree>::for_each_inline(F&& visit) const {
+    if (promoted()) {
+        return;
+    }
+    for (size_t i = 0; i < m_count; i++) {
+        visit(static_cast<const splay_tree_node&>(*m_nodes[i]));
+    }
+}
+
+template <typename Tree>
+void hybrid_bucket<Tree>::prefetch_node(size_t hash) const {
+    if (promoted()) {
+        prefetch(m_tree->get_root());
+        return;
+    }
+    unsigned char tag = hash_tag(hash);
+    for (size_t i = 0; i < m_count; i++) {
+        if (m_tags[i] == tag) {
+            prefetch(m_nodes[i]);
+            return;
+        }
+    }
+}
+
+template <typename Tree>
+template <typename Q>
+typename hybrid_bucket<Tree>::splay_tree_node* hybrid_bucket<Tree>::find_node(const Q& key, size_t hash) {
+    if (promoted()) {
+        return m_tree->find_node(key);
+    }
+    return const_cast<splay_tree_node*>(static_cast<const hybrid_bucket&>(*this).find_node(key, hash));
+}
+
+template <typename Tree>
+template <typename Q>
+const typename hybrid_bucket<Tree>::splay_tree_node* hybrid_bucket<Tree>::find_node(const Q& key, size_t hash) const {
+    if (promoted()) {
+        return static_cast<const Tree*>(m_tree)->find_node(key);
+    }
+    unsigned char tag = hash_tag(hash);
+    for (size_t i = 0; i < m_count; i++) {
+        if (m_tags[i] == tag && !(key < m_nodes[i]->m_key) && !(key > m_nodes[i]->m_key)) {
+            return m_nodes[i];
+        }
+    }
+    return nullptr;
+}
+
+template <typename Tree>
+void hybrid_bucket<Tree>::insert_node(splay_tree_node* node, size_t hash, arena_type& arena) {
+    if (!promoted()) {
+        if (find_node(node->m_key, hash) != nullptr) {
+            throw duplicate_key();
+        }
+        if (m_count < small_bucket_size) {
+            add_inline(node, hash);
+            return;
+        }
+        promote(arena);
+    }
+    m_tree->insert_node(node);
+}
+
+template <typename Tree>
+void hybrid_bucket<Tree>::insert_sorted_nodes(splay_tree_node* const* nodes, const size_t* hashes, size_t count, arena_type& arena) {
+    if (!promoted() && m_count + count <= small_bucket_size) {
+        // Check everything first, so the nodes stay with the caller on a throw
+        for (size_t i = 0; i < count; i++) {
+            if (i > 0 && !(nodes[i - 1]->m_key < nodes[i]->m_key)) {
+                if (!(nodes[i - 1]->m_key > nodes[i]->m_key)) {
+                    throw duplicate_key();
+                }
+                throw std::invalid_argument("Keys not sorted!");
+            }
+            if (find_node(nodes[i]->m_key, hashes[i]) != nullptr) {
+                throw duplicate_key();
+            }
+        }
+        for (size_t i = 0; i < count; i++) {
+            add_inline(nodes[i], hashes[i]);
+        }
+        return;
+    }
+    if (!promoted()) {
+        promote(arena);
+    }
+    m_tree->insert_sorted_nodes(nodes, count);
+}
+
+template <typename Tree>
+template <typename Q, typename NodeHash>
+typename hybrid_bucket<Tree>::holder hybrid_bucket<Tree>::extract(const Q& key, size_t hash, arena_type& arena, NodeHash&& nodeHash) {
+    if (promoted()) {
+        holder value = m_tree->extract(key);
+        if (m_tree->size() <= demotion_size) {
+            demote(nodeHash);
+        }
+        return value;
+    }
+    splay_tree_node* node = find_node(key, hash);
+    if (node == nullptr) {
+        throw nonexistent_key();
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < m_count; i++) {
+        if (m_nodes[i] != node) {
+            m_nodes[kept] = m_nodes[i];
+            m_tags[kept] = m_tags[i];
+            kept++;
+        }
+    }
+    m_count = static_cast<unsigned char>(kept);
+    holder value = std::move(node->m_value);
+    arena.destroy(node);
+    return value;
+}
+
+template <typename Tree>
+template <typename F>
+void hybrid_bucket<Tree>::release_nodes(F&& release) {
+    if (promoted()) {
+        Tree* tree = m_tree;
+        m_count = 0;
+        tree->release_nodes(release);
+        delete tree;
+        return;
+    }
+    splay_tree_node* nodes[small_bucket_size];
+    size_t count = m_count;
+    m_count = 0;
+    // Sort the few nodes by key with an insertion sort
+    for (size_t i = 0; i < count; i++) {
+        size_t j = i;
+        for (; j > 0 && m_nodes[i]->m_key < nodes[j - 1]->m_key; j--) {
+            nodes[j] = nodes[j - 1];
+        }
+        nodes[j] = m_nodes[i];
+    }
+    for (size_t i = 0; i < count; i++) {
+        nodes[i]->m_left = nullptr;
+        nodes[i]->m_right = nullptr;
+        release(nodes[i]);
+    }
+}
+
+template <typename Tree>
+void hybrid_bucket<Tree>::take(hybrid_bucket& other) noexcept {
+    m_count = other.m_count;
+    if (other.promoted()) {
+        m_tree = other.m_tree;
+    } else {
+        for (size_t i = 0; i < m_count; i++) {
+            m_nodes[i] = other.m_nodes[i];
+            m_tags[i] = other.m_tags[i];
+        }
+    }
+    other.m_count = 0;
+}
+
+template <typename Tree>
+unsigned char hybrid_bucket<Tree>::hash_tag(size_t hash) {
+    return static_cast<unsigned char>(hash >> (std::numeric_limits<size_t>::digits - 8));
+}
+
+template <typename Tree>
+void hybrid_bucket<Tree>::add_inline(splay_tree_node* node, size_t hash) {
+    m_nodes[m_count] = node;
+    m_tags[m_count] = hash_tag(hash);
+    m_count++;
+}
+
+template <typename Tree>
+void hybrid_bucket<Tree>::promote(arena_type& arena) {
+    Tree* tree = new Tree(arena);
+    try {
+        for (size_t i = 0; i < m_count; i++) {
+            tree->insert_node(m_nodes[i]);
+        }
+    } catch (...) {
+        // Hand the nodes back to m_nodes, which still lists them
+        tree->release_nodes([](splay_tree_node*) {});
+        delete tree;
+        throw;
+    }
+    m_tree = tree;
+    m_count = promoted_count;
+}
+
+template <typename Tree>
+template <typename NodeHash>
+void hybrid_bucket<Tree>::demote(NodeHash&& nodeHash) {
+    Tree* tree = m_tree;
+    m_count = 0;
+    tree->release_nodes([&](splay_tree_node* node) {
+        m_nodes[m_count] = node;
+        m_tags[m_count] = hash_tag(nodeHash(*node));
+        m_count++;
+    });
+    delete tree;
+}
+
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <type_traits>
+namespace cs251 {
+
+// Whether containers keyed by K may look keys up by a Q as it is, without
+// converting it to K first. Types that convert to K implicitly (const char*
+// for std::string, double for int) keep taking the exact K overloads, so
+// only genuine key views such as std::string_view qualify
+template <typename K, typename Q>
+struct is_heterogeneous_key : std::bool_constant<!std::is_convertible_v<const Q&, K>> {};
+
+// Whether a hash container keyed by K with hasher Hash may look keys up by a
+// Q: Hash must declare is_transparent, promising that it hashes a Q like
+// the K it compares equal to
+template <typename K, typename Hash, typename Q, typename = void>
+struct is_transparent_lookup : std::false_type {};
+template <typename K, typename Hash, typename Q>
+struct is_transparent_lookup<K, Hash, Q, std::void_t<typename Hash::is_transparent>>
+	: is_heterogeneous_key<K, Q> {};
+
+}
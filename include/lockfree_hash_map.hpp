@@ -0,0 +1,335 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+#include "exceptions.hpp"
+#include "hazard_pointer.hpp"
+#include "hash_mix.hpp"
+namespace cs251 {
+
+// Open-addressing hash map for read-mostly concurrent access
+// Readers are lock-free: peek walks the linear probe sequence with atomic
+// loads, protecting the table and the value it reads with hazard pointers
+// Writers are not: they hold a shared lock that growing the table takes
+// exclusively, so every writer blocks while the table grows. Otherwise they
+// claim slots and publish values with compare-and-swap without blocking
+// each other, and extract waits only for readers of the value it removed
+// A slot keeps its key once claimed, so extract leaves a tombstone (the key
+// with a null value) that a later insert of the same key revives, and every
+// key owns at most one slot per table
+// Hash maps a key to a size_t whose low bits pick the home slot
+template <typename K, typename V, typename Hash = mixed_hash<K>>
+class lockfree_hash_map {
+public:
+	// The hasher type
+	using hasher = Hash;
+
+	// Default constructor - create a hash map with an initial capacity of 1
+	lockfree_hash_map();
+	// Constructor - create a hash map with an initial capacity of bucketCount,
+	// rounded up to a power of two
+	lockfree_hash_map(size_t bucketCount, const Hash& hash = Hash());
+	~lockfree_hash_map();
+	lockfree_hash_map(const lockfree_hash_map&) = delete;
+	lockfree_hash_map& operator=(const lockfree_hash_map&) = delete;
+
+	// Insert the key/value pair into the table, if the key doesn't already exist
+	// Throw duplicate_key if the key already exists
+	void insert(const K& key, std::unique_ptr<V> value);
+	// Return a copy of the value associated with the given key, since a
+	// reference could outlive the value once another thread extracts it
+	// Throw nonexistent_key if the key is not in the hash table
+	V peek(const K& key) const;
+	// Call visitor with a const reference to the value associated with the
+	// given key, for values that are not copyable; the value stays alive
+	// until visitor returns
+	// Throw nonexistent_key if the key is not in the hash table
+	template <typename F>
+	void visit(const K& key, F&& visitor) const;
+	// Remove and return the value associated with the given key, once no
+	// reader can still be looking at it; this waits for the peek or visit
+	// calls that read the value before it was removed, and for no others
+	// Throw nonexistent_key if the key is not in the hash table
+	std::unique_ptr<V> extract(const K& key);
+
+	// Return the current number of elements in the hash table
+	size_t size() const;
+	// Return the current capacity of the hash table
+	size_t bucket_count() const;
+	// Return whether the hash table is currently empty
+	bool empty() const;
+
+private:
+	// Slot states; a slot only ever moves forward through them
+	static constexpr uint8_t slot_empty = 0;
+	// Claimed by an insert that is still writing the key
+	static constexpr uint8_t slot_busy = 1;
+	// The key is published and never changes again
+	static constexpr uint8_t slot_full = 2;
+
+	// Fraction of the slots that may be claimed, tombstones included
+	static constexpr float max_load_factor = 0.75f;
+
+	struct slot {
+		std::atomic<uint8_t> m_state{slot_empty};
+		K m_key = {};
+		// The value of the key, or nullptr while the key is absent
+		std::atomic<V*> m_value{nullptr};
+	};
+
+	struct table {
+		explicit table(size_t bucketCount)
+			: m_slots(new slot[bucketCount]), m_bucket_count(bucketCount), m_mask(bucketCount - 1) {}
+		std::unique_ptr<slot[]> m_slots;
+		// A power of two
+		size_t m_bucket_count;
+		size_t m_mask;
+		// The number of slots no longer empty
+		std::atomic<size_t> m_used{0};
+	};
+
+	// Return the slot holding key in t, or nullptr if key never had one
+	const slot* find_slot(const table& t, const K& key) const;
+	slot* find_slot(table& t, const K& key);
+	// Return the slot holding key in t, claiming the first empty slot of its
+	// probe sequence if it has none, or nullptr if t is too full to claim one
+	slot* claim_slot(table& t, const K& key);
+	// Replace full with a table that has room for twice the live elements,
+	// unless another writer already did
+	void grow(table* full);
+	// Free the retired tables no reader protects any more
+	void reclaim_tables();
+	// Return the value of key, protected in hazard for as long as it is held
+	// Throw nonexistent_key if the key is not in the hash table
+	const V& find_value(hazard_domain::guard& hazard, const K& key) const;
+
+	// The hash function
+	Hash m_hasher {};
+	// The current table, swapped only by grow
+	std::atomic<table*> m_table;
+	// The number of keys with a value
+	std::atomic<size_t> m_size{0};
+	// Tables and values that peek and visit are reading, so extract and
+	// grow know when memory they unlinked is no longer visible
+	mutable hazard_domain m_hazards;
+	// Shared by writers, exclusive while grow copies the table
+	std::shared_mutex m_writers;
+	// Tables replaced by grow that a reader may still be probing; freed in
+	// batches by later grows and by the destructor
+	std::vector<table*> m_retired;
+};
+
+template <typename K, typename V, typename Hash>
+lockfree_hash_map<K,V,Hash>::lockfree_hash_map() : m_table(new table(1)) {
+}
+
+template <typename K, typename V, typename Hash>
+lockfree_hash_map<K,V,Hash>::lockfree_hash_map(const size_t bucketCount, const Hash& hash)
+        : m_hasher(hash), m_table(new table(next_power_of_two(bucketCount))) {
+}
+
+template <typename K, typename V, typename Hash>
+lockfree_hash_map<K,V,Hash>::~lockfree_hash_map() {
+    table* t = m_table.load();
+    for (size_t i = 0; i < t->m_bucket_count; i++) {
+        delete t->m_slots[i].m_value.load();
+    }
+    delete t;
+    for (table* retired : m_retired) {
+        delete retired;
+    }
+}
+
+template <typename K, typename V, typename Hash>
+const typename lockfree_hash_map<K,V,Hash>::slot* lockfree_hash_map<K,V,Hash>::find_slot(const table& t, const K& key) const {
+    size_t index = m_hasher(key) & t.m_mask;
+    for (size_t probed = 0; probed < t.m_bucket_count; probed++) {
+        const slot& s = t.m_slots[index];
+        uint8_t state = s.m_state.load(std::memory_order_acquire);
+        if (state == slot_empty) {
+            return nullptr;
+        }
+        // A busy slot is still getting its key, whose value is not set yet
+        if (state == slot_full && s.m_key == key) {
+            return &s;
+        }
+        index = (index + 1) & t.m_mask;
+    }
+    return nullptr;
+}
+
+template <typename K, typename V, typename Hash>
+typename lockfree_hash_map<K,V,Hash>::slot* lockfree_hash_map<K,V,Hash>::find_slot(table& t, const K& key) {
+    return const_cast<slot*>(static_cast<const lockfree_hash_map&>(*this).find_slot(t, key));
+}
+
+template <typename K, typename V, typename Hash>
+typename lockfree_hash_map<K,V,Hash>::slot* lockfree_hash_map<K,V,Hash>::claim_slot(table& t, const K& key) {
+    size_t limit = static_cast<size_t>(max_load_factor * t.m_bucket_count);
+    size_t index = m_hasher(key) & t.m_mask;
+    for (size_t probed = 0; probed < t.m_bucket_count; probed++) {
+        slot& s = t.m_slots[index];
+        uint8_t state = s.m_state.load(std::memory_order_acquire);
+        if (state == slot_empty) {
+            // Slots never become empty again, so key is not further along
+            if (t.m_used.load(std::memory_order_relaxed) >= limit) {
+                return nullptr;
+            }
+            if (s.m_state.compare_exchange_strong(state, slot_busy, std::memory_order_acquire)) {
+                t.m_used.fetch_add(1, std::memory_order_relaxed);
+                s.m_key = key;
+                s.m_state.store(slot_full, std::memory_order_release);
+                return &s;
+            }
+        }
+        // The slot may be claimed for this very key, so wait for its key
+        while (state == slot_busy) {
+            std::this_thread::yield();
+            state = s.m_state.load(std::memory_order_acquire);
+        }
+        if (s.m_key == key) {
+            return &s;
+        }
+        index = (index + 1) & t.m_mask;
+    }
+    return nullptr;
+}
+
+template <typename K, typename V, typename Hash>
+void lockfree_hash_map<K,V,Hash>::grow(table* full) {
+    std::unique_lock<std::shared_mutex> lock(m_writers);
+    if (m_table.load() != full) {
+        return;
+    }
+    size_t bucketCount = full->m_bucket_count;
+    while ((m_size.load() + 1) * 2 > max_load_factor * bucketCount) {
+        bucketCount *= 2;
+    }
+    // No writer runs now, so the copy can be placed without atomics
+    // contending; tombstones are left behind
+    table* fresh = new table(bucketCount);
+    for (size_t i = 0; i < full->m_bucket_count; i++) {
+        const slot& s = full->m_slots[i];
+        V* value = s.m_value.load();
+        if (value == nullptr) {
+            continue;
+        }
+        size_t index = m_hasher(s.m_key) & fresh->m_mask;
+        while (fresh->m_slots[index].m_state.load(std::memory_order_relaxed) != slot_empty) {
+            index = (index + 1) & fresh->m_mask;
+        }
+        slot& target = fresh->m_slots[index];
+        target.m_key = s.m_key;
+        target.m_value.store(value, std::memory_order_relaxed);
+        target.m_state.store(slot_full, std::memory_order_relaxed);
+        fresh->m_used.fetch_add(1, std::memory_order_relaxed);
+    }
+    m_table.store(fresh);
+    // The values now belong to fresh; the old slots go once readers are done
+    m_retired.push_back(full);
+    reclaim_tables();
+}
+
+template <typename K, typename V, typename Hash>
+void lockfree_hash_map<K,V,Hash>::reclaim_tables() {
+    size_t kept = 0;
+    for (table* retired : m_retired) {
+        if (m_hazards.is_protected(retired)) {
+            m_retired[kept++] = retired;
+        } else {
+            delete retired;
+        }
+    }
+    m_retired.resize(kept);
+}
+
+template <typename K, typename V, typename Hash>
+void lockfree_hash_map<K,V,Hash>::insert(const K& key, std::unique_ptr<V> value) {
+    std::shared_lock<std::shared_mutex> lock(m_writers);
+    table* t = m_table.load(std::memory_order_acquire);
+    slot* s = claim_slot(*t, key);
+    while (s == nullptr) {
+        lock.unlock();
+        grow(t);
+        lock.lock();
+        t = m_table.load(std::memory_order_acquire);
+        s = claim_slot(*t, key);
+    }
+    V* expected = nullptr;
+    if (!s->m_value.compare_exchange_strong(expected, value.get())) {
+        throw duplicate_key();
+    }
+    value.release();
+    m_size.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename K, typename V, typename Hash>
+const V& lockfree_hash_map<K,V,Hash>::find_value(hazard_domain::guard& hazard, const K& key) const {
+    for (;;) {
+        table* t = hazard.protect(0, m_table);
+        const slot* s = find_slot(*t, key);
+        V* value = s == nullptr ? nullptr : s->m_value.load();
+        if (value == nullptr) {
+            throw nonexistent_key();
+        }
+        hazard.protect(1, value);
+        // Safe unless extract took the value or grow moved it to another
+        // table, where extract could take it without touching this slot
+        if (s->m_value.load() == value && m_table.load() == t) {
+            return *value;
+        }
+    }
+}
+
+template <typename K, typename V, typename Hash>
+V lockfree_hash_map<K,V,Hash>::peek(const K& key) const {
+    auto hazard = m_hazards.acquire();
+    return find_value(hazard, key);
+}
+
+template <typename K, typename V, typename Hash>
+template <typename F>
+void lockfree_hash_map<K,V,Hash>::visit(const K& key, F&& visitor) const {
+    auto hazard = m_hazards.acquire();
+    visitor(find_value(hazard, key));
+}
+
+template <typename K, typename V, typename Hash>
+std::unique_ptr<V> lockfree_hash_map<K,V,Hash>::extract(const K& key) {
+    V* value = nullptr;
+    {
+        std::shared_lock<std::shared_mutex> lock(m_writers);
+        slot* s = find_slot(*m_table.load(std::memory_order_acquire), key);
+        if (s != nullptr) {
+            value = s->m_value.exchange(nullptr);
+        }
+        if (value == nullptr) {
+            throw nonexistent_key();
+        }
+        m_size.fetch_sub(1, std::memory_order_relaxed);
+    }
+    // Readers that protected the value before the exchange may still use it
+    m_hazards.wait_unprotected(value);
+    return std::unique_ptr<V>(value);
+}
+
+template <typename K, typename V, typename Hash>
+size_t lockfree_hash_map<K,V,Hash>::size() const {
+    return m_size.load(std::memory_order_relaxed);
+}
+
+template <typename K, typename V, typename Hash>
+size_t lockfree_hash_map<K,V,Hash>::bucket_count() const {
+    return m_table.load()->m_bucket_count;
+}
+
+template <typename K, typename V, typename Hash>
+bool lockfree_hash_map<K,V,Hash>::empty() const {
+    return size() == 0;
+}
+
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <new>
+#include <utility>
+namespace cs251 {
+
+// Slab allocator for fixed-size nodes. Nodes are carved out of chunks that
+// double in size up to max_chunk_size, freed nodes are kept on an intrusive
+// free list for reuse, and every chunk is released at once by clear() or
+// the destructor. Owners must destroy their live nodes before that.
+template <typename T>
+class node_arena {
+public:
+	node_arena() = default;
+	node_arena(const node_arena&) = delete;
+	node_arena& operator=(const node_arena&) = delete;
+
+	// Construct a node in the arena from args
+	// If T's constructor throws, the slot goes back on the free list
+	template <typename... Args>
+	T* create(Args&&... args);
+	// Destroy a node created by this arena and keep its memory for reuse
+	void destroy(T* node);
+	// Release every chunk at once; no node created by this arena may still be in use
+	void clear();
+
+private:
+	// Storage for one node, reused as a free list link once the node is destroyed
+	union slot {
+		slot* m_next;
+		alignas(T) unsigned char m_storage[sizeof(T)];
+	};
+
+	// Smallest and largest number of nodes allocated per chunk
+	static constexpr size_t min_chunk_size = 16;
+	static constexpr size_t max_chunk_size = 4096;
+
+	// Every chunk allocated so far
+	std::vector<std::unique_ptr<slot[]>> m_chunks {};
+	// Head of the list of destroyed nodes
+	slot* m_free = nullptr;
+	// Slots of the newest chunk not handed out yet
+	slot* m_next_unused = nullptr;
+	slot* m_chunk_end = nullptr;
+	// Size of the next chunk to allocate
+	size_t m_chunk_size = min_chunk_size;
+};
+
+template <typename T>
+template <typename... Args>
+T* node_arena<T>::create(Args&&... args) {
+    slot* s = m_free;
+    if (s != nullptr) {
+        m_free = s->m_next;
+    } else {
+        if (m_next_unused == m_chunk_end) {
+            m_chunks.push_back(std::unique_ptr<slot[]>(new slot[m_chunk_size]));
+            m_next_unused = m_chunks.back().get();
+            m_chunk_end = m_next_unused + m_chunk_size;
+            if (m_chunk_size < max_chunk_size) {
+                m_chunk_size *= 2;
+            }
+        }
+        s = m_next_unused++;
+    }
+    try {
+        return ::new (static_cast<void*>(s->m_storage)) T(std::forward<Args>(args)...);
+    } catch (...) {
+        s->m_next = m_free;
+        m_free = s;
+        throw;
+    }
+}
+
+template <typename T>
+void node_arena<T>::destroy(T* node) {
+    node->~T();
+    slot* s = reinterpret_cast<slot*>(node);
+    s->m_next = m_free;
+    m_free = s;
+}
+
+template <typename T>
+void node_arena<T>::clear() {
+    m_chunks.clear();
+    m_free = nullptr;
+    m_next_unused = nullptr;
+    m_chunk_end = nullptr;
+    m_chunk_size = min_chunk_size;
+}
+
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CS251_X86_GROUPS 1
+#endif
+namespace cs251 {
+
+// The widest group any implementation reads, so control arrays keep this many
+// bytes minus one cloned past their end and a group load never runs off it
+constexpr size_t max_group_width = 32;
+
+// A group implementation compares a run of control bytes against one value at
+// a time and reports the matching positions as a bitmask, lowest slot first
+struct probe_group {
+	// Number of control bytes compared per match
+	size_t m_width;
+	// Return a mask with bit i set when ctrl[i] == value, for i < m_width
+	uint32_t (*m_match)(const int8_t* ctrl, int8_t value);
+};
+
+// Return the position of the lowest set bit of a nonzero match mask
+inline size_t lowest_match(uint32_t mask) {
+#if defined(__GNUC__)
+    return static_cast<size_t>(__builtin_ctz(mask));
+#else
+    size_t bit = 0;
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+// Hint that the cache line holding address will be read soon, so batched
+// lookups can overlap their cache misses; a no-op where unsupported
+inline void prefetch(const void* address) {
+#if defined(__GNUC__)
+    __builtin_prefetch(address);
+#else
+    (void)address;
+#endif
+}
+
+// Portable fallback, one byte at a time
+inline uint32_t match_group_scalar(const int8_t* ctrl, int8_t value) {
+    uint32_t mask = 0;
+    for (size_t i = 0; i < 16; i++) {
+        if (ctrl[i] == value) {
+            mask |= uint32_t(1) << i;
+        }
+    }
+    return mask;
+}
+
+#if defined(CS251_X86_GROUPS)
+// 16 control bytes per compare; SSE2 is part of every x86-64 target
+__attribute__((target("sse2")))
+inline uint32_t match_group_sse2(const int8_t* ctrl, int8_t value) {
+    __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+    __m128i matches = _mm_cmpeq_epi8(group, _mm_set1_epi8(value));
+    return static_cast<uint32_t>(_mm_movemask_epi8(matches));
+}
+
+// 32 control bytes per compare, only selected when the CPU reports AVX2
+__attribute__((target("avx2")))
+inline uint32_t match_group_avx2(const int8_t* ctrl, int8_t value) {
+    __m256i group = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ctrl));
+    __m256i matches = _mm256_cmpeq_epi8(group, _mm256_set1_epi8(value));
+    return static_cast<uint32_t>(_mm256_movemask_epi8(matches));
+}
+#endif
+
+// Pick the widest implementation the running CPU supports
+inline probe_group select_probe_group() {
+#if defined(CS251_X86_GROUPS)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return probe_group{32, &match_group_avx2};
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return probe_group{16, &match_group_sse2};
+    }
+#endif
+    return probe_group{16, &match_group_scalar};
+}
+
+// Return the group implementation chosen for this process
+inline const probe_group& active_probe_group() {
+    static const probe_group group = select_probe_group();
+    return group;
+}
+
+}
@@ -0,0 +1,198 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+namespace cs251 {
+
+// Incremental SipHash, a keyed hash whose outputs an attacker who does not
+// know the key cannot predict, so chosen keys cannot be steered into one
+// probe run or bucket. CompressionRounds and FinalizationRounds select the
+// variant; sip_hasher is SipHash-1-3, the usual choice for hash tables
+template <int CompressionRounds, int FinalizationRounds>
+class basic_sip_hasher {
+public:
+	basic_sip_hasher(uint64_t k0, uint64_t k1);
+	// Feed length bytes at data into the hash
+	void append(const void* data, size_t length);
+	// Return the hash of every byte appended so far
+	uint64_t finish() const;
+
+private:
+	static uint64_t rotate(uint64_t x, int bits) { return (x << bits) | (x >> (64 - bits)); }
+	// Apply rounds SipRounds to the state in v
+	static void sip_rounds(uint64_t (&v)[4], int rounds);
+	// Mix one 8-byte message word into the state
+	static void compress(uint64_t (&v)[4], uint64_t word);
+
+	uint64_t m_v[4];
+	// Bytes appended since the last full word, lowest first
+	uint64_t m_tail = 0;
+	// Total number of bytes appended
+	size_t m_length = 0;
+};
+
+using sip_hasher = basic_sip_hasher<1, 3>;
+
+template <int CompressionRounds, int FinalizationRounds>
+basic_sip_hasher<CompressionRounds, FinalizationRounds>::basic_sip_hasher(uint64_t k0, uint64_t k1) {
+    m_v[0] = k0 ^ 0x736F6D6570736575ull;
+    m_v[1] = k1 ^ 0x646F72616E646F6Dull;
+    m_v[2] = k0 ^ 0x6C7967656E657261ull;
+    m_v[3] = k1 ^ 0x7465646279746573ull;
+}
+
+template <int CompressionRounds, int FinalizationRounds>
+void basic_sip_hasher<CompressionRounds, FinalizationRounds>::sip_rounds(uint64_t (&v)[4], int rounds) {
+    for (int i = 0; i < rounds; i++) {
+        v[0] += v[1]; v[1] = rotate(v[1], 13); v[1] ^= v[0]; v[0] = rotate(v[0], 32);
+        v[2] += v[3]; v[3] = rotate(v[3], 16); v[3] ^= v[2];
+        v[0] += v[3]; v[3] = rotate(v[3], 21); v[3] ^= v[0];
+        v[2] += v[1]; v[1] = rotate(v[1], 17); v[1] ^= v[2]; v[2] = rotate(v[2], 32);
+    }
+}
+
+template <int CompressionRounds, int FinalizationRounds>
+void basic_sip_hasher<CompressionRounds, FinalizationRounds>::compress(uint64_t (&v)[4], uint64_t word) {
+    v[3] ^= word;
+    sip_rounds(v, CompressionRounds);
+    v[0] ^= word;
+}
+
+template <int CompressionRounds, int FinalizationRounds>
+void basic_sip_hasher<CompressionRounds, FinalizationRounds>::append(const void* data, size_t length) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    size_t filled = m_length % 8;
+    m_length += length;
+    // Top up a partial word first
+    while (filled != 0 && length != 0) {
+        m_tail |= static_cast<uint64_t>(*bytes++) << (8 * filled);
+        length--;
+        if (++filled == 8) {
+            compress(m_v, m_tail);
+            m_tail = 0;
+            filled = 0;
+        }
+    }
+    for (; length >= 8; bytes += 8, length -= 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes, 8);
+        compress(m_v, word);
+    }
+    for (size_t i = 0; i < length; i++) {
+        m_tail |= static_cast<uint64_t>(bytes[i]) << (8 * i);
+    }
+}
+
+template <int CompressionRounds, int FinalizationRounds>
+uint64_t basic_sip_hasher<CompressionRounds, FinalizationRounds>::finish() const {
+    uint64_t v[4] = { m_v[0], m_v[1], m_v[2], m_v[3] };
+    compress(v, m_tail | (static_cast<uint64_t>(m_length) << 56));
+    v[2] ^= 0xFF;
+    sip_rounds(v, FinalizationRounds);
+    return v[0] ^ v[1] ^ v[2] ^ v[3];
+}
+
+// Feed a value into a keyed hasher. Key types outside the standard library
+// hook in with an overload of their own, found by argument-dependent lookup
+template <typename H, typename T>
+std::enable_if_t<std::is_arithmetic_v<T> || std::is_enum_v<T>> hash_append(H& hasher, const T& value) {
+    if constexpr (std::is_floating_point_v<T>) {
+        // 0.0 and -0.0 compare equal, so they must hash alike
+        if (value == 0) {
+            hash_append(hasher, 0);
+            return;
+        }
+    }
+    hasher.append(&value, sizeof(value));
+}
+
+template <typename H>
+void hash_append(H& hasher, std::string_view value) {
+    // Appending the length keeps consecutive fields from running together
+    hasher.append(value.data(), value.size());
+    hash_append(hasher, value.size());
+}
+
+template <typename H>
+void hash_append(H& hasher, const std::string& value) {
+    hash_append(hasher, std::string_view(value));
+}
+
+// Whether key type K has a hash_append overload; other keys are hashed
+// through std::hash first, so collisions of std::hash itself still collide
+template <typename K, typename = void>
+struct has_hash_append : std::false_type {};
+template <typename K>
+struct has_hash_append<K, std::void_t<decltype(hash_append(std::declval<sip_hasher&>(), std::declval<const K&>()))>>
+	: std::true_type {};
+
+// Hasher keyed with a random per-instance seed, resisting hash flooding for
+// the price of SipHash instead of a multiply-xorshift mixer
+// Containers notice the reseed() member and call it to rehash under a new
+// seed when a key lands pathologically far from its home
+template <typename K>
+class seeded_hash {
+public:
+	// Seed from std::random_device
+	seeded_hash() { reseed(); }
+	// Use a fixed seed, for reproducible layouts
+	seeded_hash(uint64_t k0, uint64_t k1) : m_k0(k0), m_k1(k1) {}
+
+	// Transparent, so lookups may pass a key view Q whose hash_append feeds
+	// the same bytes as that of the equal K
+	using is_transparent = void;
+
+	size_t operator()(const K& key) const {
+		return hash(key);
+	}
+	template <typename Q>
+	size_t operator()(const Q& key) const {
+		return hash(key);
+	}
+
+	// Replace the seed with a fresh random one
+	void reseed() {
+		std::random_device device;
+		m_k0 = (static_cast<uint64_t>(device()) << 32) ^ device();
+		m_k1 = (static_cast<uint64_t>(device()) << 32) ^ device();
+	}
+
+private:
+	template <typename Q>
+	size_t hash(const Q& key) const {
+		sip_hasher hasher(m_k0, m_k1);
+		if constexpr (has_hash_append<Q>::value) {
+			hash_append(hasher, key);
+		} else {
+			hash_append(hasher, std::hash<Q>{}(key));
+		}
+		return static_cast<size_t>(hasher.finish());
+	}
+
+	uint64_t m_k0 = 0;
+	uint64_t m_k1 = 0;
+};
+
+// Whether hasher type Hash can be reseeded
+template <typename Hash, typename = void>
+struct is_reseedable : std::false_type {};
+template <typename Hash>
+struct is_reseedable<Hash, std::void_t<decltype(std::declval<Hash&>().reseed())>> : std::true_type {};
+
+// Return the base-2 logarithm of count, rounded down, or 0 for 0
+inline size_t floor_log2(size_t count) {
+    size_t log = 0;
+    while (count > 1) {
+        count /= 2;
+        log++;
+    }
+    return log;
+}
+
+}
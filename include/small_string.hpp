@@ -0,0 +1,243 @@
+#pragma once
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+namespace cs251 {
+
+// Immutable string for short keys such as names: up to InlineCapacity
+// characters live inside the object itself, and only longer strings spill
+// into a single heap allocation of exactly their size
+// small_string holds 23 characters inline in 24 bytes, where std::string
+// takes 32 bytes and allocates past 15
+// Hashes and compares like the std::string_view it converts to, so maps
+// keyed by it accept string_view lookups without building a key
+// Offers the read-only part of the std::string interface and converts
+// implicitly to std::string, so code written against std::string members
+// keeps compiling unless it modifies the string in place
+template <size_t InlineCapacity>
+class basic_small_string {
+	static_assert(InlineCapacity >= sizeof(char*) + sizeof(size_t) && InlineCapacity < 255,
+		"the inline buffer must hold the heap pointer and size, and its size fit a byte");
+public:
+	using value_type = char;
+	using size_type = size_t;
+	using const_iterator = const char*;
+	using iterator = const_iterator;
+	static constexpr size_t npos = std::string_view::npos;
+
+	basic_small_string() noexcept { set_inline_size(0); }
+	explicit basic_small_string(std::string_view s) { init(s.data(), s.size()); }
+	basic_small_string(const char* s) : basic_small_string(std::string_view(s)) {}
+	basic_small_string(const std::string& s) : basic_small_string(std::string_view(s)) {}
+	basic_small_string(const basic_small_string& other) { init(other.data(), other.size()); }
+	basic_small_string(basic_small_string&& other) noexcept { take(other); }
+	basic_small_string& operator=(const basic_small_string& other) {
+		if (this != &other) {
+			basic_small_string copy(other);
+			release();
+			take(copy);
+		}
+		return *this;
+	}
+	basic_small_string& operator=(basic_small_string&& other) noexcept {
+		if (this != &other) {
+			release();
+			take(other);
+		}
+		return *this;
+	}
+	~basic_small_string() { release(); }
+
+	const char* data() const noexcept { return is_inline() ? m_buffer : heap_data(); }
+	// The characters are always followed by a null, as in std::string
+	const char* c_str() const noexcept { return data(); }
+	size_t size() const noexcept { return is_inline() ? inline_size() : heap_size(); }
+	size_t length() const noexcept { return size(); }
+	bool empty() const noexcept { return size() == 0; }
+	operator std::string_view() const noexcept { return std::string_view(data(), size()); }
+	operator std::string() const { return std::string(data(), size()); }
+	std::string str() const { return std::string(data(), size()); }
+
+	// Read-only std::string members, answered by the equal string_view
+	char operator[](size_t index) const noexcept { return data()[index]; }
+	char at(size_t index) const { return std::string_view(*this).at(index); }
+	char front() const noexcept { return data()[0]; }
+	char back() const noexcept { return data()[size() - 1]; }
+	const_iterator begin() const noexcept { return data(); }
+	const_iterator end() const noexcept { return data() + size(); }
+	const_iterator cbegin() const noexcept { return begin(); }
+	const_iterator cend() const noexcept { return end(); }
+	int compare(std::string_view other) const noexcept { return std::string_view(*this).compare(other); }
+	size_t find(std::string_view s, size_t pos = 0) const noexcept { return std::string_view(*this).find(s, pos); }
+	size_t find(char c, size_t pos = 0) const noexcept { return std::string_view(*this).find(c, pos); }
+	size_t rfind(std::string_view s, size_t pos = npos) const noexcept { return std::string_view(*this).rfind(s, pos); }
+	size_t rfind(char c, size_t pos = npos) const noexcept { return std::string_view(*this).rfind(c, pos); }
+	std::string substr(size_t pos = 0, size_t count = npos) const { return std::string(std::string_view(*this).substr(pos, count)); }
+
+private:
+	// Tag byte of a string that spilled to the heap
+	static constexpr unsigned char heap_tag = 255;
+
+	// The last byte of m_buffer holds InlineCapacity minus the length of an
+	// inline string, which is 0 and so terminates a full buffer, or heap_tag
+	unsigned char tag() const noexcept { return static_cast<unsigned char>(m_buffer[InlineCapacity]); }
+	void set_tag(unsigned char tag) noexcept { m_buffer[InlineCapacity] = static_cast<char>(tag); }
+	size_t inline_size() const noexcept { return InlineCapacity - tag(); }
+	// Make this an inline string of size characters already in m_buffer
+	void set_inline_size(size_t size) noexcept {
+		m_buffer[size] = '\0';
+		set_tag(static_cast<unsigned char>(InlineCapacity - size));
+	}
+	bool is_inline() const noexcept { return tag() != heap_tag; }
+	// The heap pointer and size of a spilled string, kept unaligned in
+	// m_buffer so the size byte fits in the same word
+	char* heap_data() const noexcept {
+		char* data;
+		std::memcpy(&data, m_buffer, sizeof(data));
+		return data;
+	}
+	size_t heap_size() const noexcept {
+		size_t size;
+		std::memcpy(&size, m_buffer + sizeof(char*), sizeof(size));
+		return size;
+	}
+	// Move the representation of other, whose bytes are all this needs, into
+	// this string, which owns no heap buffer, and leave other empty
+	void take(basic_small_string& other) noexcept {
+		std::memcpy(m_buffer, other.m_buffer, sizeof(m_buffer));
+		other.set_inline_size(0);
+	}
+	// Free the heap buffer of a spilled string
+	void release() noexcept {
+		if (!is_inline()) {
+			delete[] heap_data();
+		}
+	}
+	// Copy size characters at data into the storage of an empty string
+	void init(const char* data, size_t size) {
+		if (size <= InlineCapacity) {
+			std::memcpy(m_buffer, data, size);
+			set_inline_size(size);
+		} else {
+			char* heap = new char[size + 1];
+			std::memcpy(heap, data, size);
+			heap[size] = '\0';
+			std::memcpy(m_buffer, &heap, sizeof(heap));
+			std::memcpy(m_buffer + sizeof(char*), &size, sizeof(size));
+			set_tag(heap_tag);
+		}
+	}
+
+	// The characters of an inline string, or the heap pointer and size of a
+	// spilled one, then the tag byte; zeroed so moves never copy
+	// indeterminate bytes
+	char m_buffer[InlineCapacity + 1] {};
+};
+
+using small_string = basic_small_string<23>;
+
+// Comparisons between small strings, and between a small string and
+// anything that converts to a string_view, ordered like string_view
+template <size_t N>
+bool operator==(const basic_small_string<N>& a, const basic_small_string<N>& b) { return std::string_view(a) == std::string_view(b); }
+template <size_t N>
+bool operator==(const basic_small_string<N>& a, std::string_view b) { return std::string_view(a) == b; }
+template <size_t N>
+bool operator==(std::string_view a, const basic_small_string<N>& b) { return a == std::string_view(b); }
+template <size_t N>
+bool operator!=(const basic_small_string<N>& a, const basic_small_string<N>& b) { return !(a == b); }
+template <size_t N>
+bool operator!=(const basic_small_string<N>& a, std::string_view b) { return !(a == b); }
+template <size_t N>
+bool operator!=(std::string_view a, const basic_small_string<N>& b) { return !(a == b); }
+template <size_t N>
+bool operator<(const basic_small_string<N>& a, const basic_small_string<N>& b) { return std::string_view(a) < std::string_view(b); }
+template <size_t N>
+bool operator<(const basic_small_string<N>& a, std::string_view b) { return std::string_view(a) < b; }
+template <size_t N>
+bool operator<(std::string_view a, const basic_small_string<N>& b) { return a < std::string_view(b); }
+template <size_t N>
+bool operator>(const basic_small_string<N>& a, const basic_small_string<N>& b) { return b < a; }
+template <size_t N>
+bool operator>(const basic_small_string<N>& a, std::string_view b) { return b < a; }
+template <size_t N>
+bool operator>(std::string_view a, const basic_small_string<N>& b) { return b < a; }
+
+template <size_t N>
+bool operator<=(const basic_small_string<N>& a, const basic_small_string<N>& b) { return !(b < a); }
+template <size_t N>
+bool operator<=(const basic_small_string<N>& a, std::string_view b) { return !(b < a); }
+template <size_t N>
+bool operator<=(std::string_view a, const basic_small_string<N>& b) { return !(b < a); }
+template <size_t N>
+bool operator>=(const basic_small_string<N>& a, const basic_small_string<N>& b) { return !(a < b); }
+template <size_t N>
+bool operator>=(const basic_small_string<N>& a, std::string_view b) { return !(a < b); }
+template <size_t N>
+bool operator>=(std::string_view a, const basic_small_string<N>& b) { return !(a < b); }
+
+// Concatenations build a std::string, as they would from std::string operands
+template <size_t N>
+std::string operator+(const basic_small_string<N>& a, std::string_view b) {
+    std::string result(a);
+    result += b;
+    return result;
+}
+template <size_t N>
+std::string operator+(std::string_view a, const basic_small_string<N>& b) {
+    std::string result(a);
+    result += std::string_view(b);
+    return result;
+}
+template <size_t N>
+std::string operator+(const basic_small_string<N>& a, const basic_small_string<N>& b) {
+    return a + std::string_view(b);
+}
+template <size_t N>
+std::string operator+(const basic_small_string<N>& a, char b) {
+    std::string result(a);
+    result += b;
+    return result;
+}
+template <size_t N>
+std::string operator+(char a, const basic_small_string<N>& b) {
+    std::string result(1, a);
+    result += std::string_view(b);
+    return result;
+}
+
+// Feed a small string to a keyed hasher exactly like the equal string_view
+template <typename H, size_t InlineCapacity>
+void hash_append(H& hasher, const basic_small_string<InlineCapacity>& value) {
+    hash_append(hasher, std::string_view(value));
+}
+
+template <size_t InlineCapacity>
+std::ostream& operator<<(std::ostream& ostr, const basic_small_string<InlineCapacity>& s) {
+    return ostr << std::string_view(s);
+}
+
+template <size_t InlineCapacity>
+std::istream& operator>>(std::istream& istr, basic_small_string<InlineCapacity>& s) {
+    std::string word;
+    if (istr >> word) {
+        s = basic_small_string<InlineCapacity>(word);
+    }
+    return istr;
+}
+
+}
+
+namespace std {
+template <size_t InlineCapacity>
+struct hash<cs251::basic_small_string<InlineCapacity>> {
+	size_t operator()(const cs251::basic_small_string<InlineCapacity>& s) const noexcept {
+		return std::hash<std::string_view>{}(s);
+	}
+};
+}
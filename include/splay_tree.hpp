@@ -2,92 +2,558 @@
 #include <sstream>
 #include <exception>
 #include <memory>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include "node_arena.hpp"
+#include "exceptions.hpp"
+#include "key_lookup.hpp"
+#include "hash_mix.hpp"
+#include "value_storage.hpp"
 namespace cs251 {
 
-// Custom exception classes
-class duplicate_key : public std::runtime_error {
-	public: duplicate_key() : std::runtime_error("Duplicate key!") {} };
-class nonexistent_key : public std::runtime_error {
-	public: nonexistent_key() : std::runtime_error("Key does not exist!") {} };
-class empty_tree : public std::runtime_error {
-	public: empty_tree() : std::runtime_error("Tree is empty!") {} };
+// What a splay_tree does with the node an access reached
+enum class splay_action { none, splay, semi_splay };
 
-template <typename K, typename V>
+// Splay policies, selecting at compile time how a splay_tree restructures
+// itself. A policy is stored in the tree and asked through on_access(depth)
+// what to do with each node reached by insert, peek, minimum_key or
+// maximum_key at the given depth below the root; extract always splays.
+// Policies with top_down set splay during the descent instead and are not asked.
+
+// Descend to the node, then rotate it back up to the root through parent links
+struct bottom_up_splay {
+	static constexpr bool top_down = false;
+	splay_action on_access(size_t) { return splay_action::splay; }
+};
+// Splay during the single descent (Sleator-Tarjan), so nodes need no parent link
+struct top_down_splay {
+	static constexpr bool top_down = true;
+	splay_action on_access(size_t) { return splay_action::splay; }
+};
+// Rotate the node only part of the way up, roughly halving the depth of its
+// path, which keeps most of the adaptivity for fewer rotations
+struct semi_splay {
+	static constexpr bool top_down = false;
+	splay_action on_access(size_t) { return splay_action::semi_splay; }
+};
+// Splay on every Period-th access only, leaving the tree alone in between
+template <size_t Period>
+struct periodic_splay {
+	static constexpr bool top_down = false;
+	splay_action on_access(size_t) {
+		if (++m_accesses < Period) {
+			return splay_action::none;
+		}
+		m_accesses = 0;
+		return splay_action::splay;
+	}
+	// Accesses since the last splay
+	size_t m_accesses = 0;
+};
+// Splay only nodes found deeper than Depth, so shallow hits cost no rotations
+template <size_t Depth>
+struct depth_splay {
+	static constexpr bool top_down = false;
+	splay_action on_access(size_t depth) {
+		return depth > Depth ? splay_action::splay : splay_action::none;
+	}
+};
+// Never restructure on access, for uniform workloads where rotations are pure overhead
+struct no_splay {
+	static constexpr bool top_down = false;
+	splay_action on_access(size_t) { return splay_action::none; }
+};
+
+// Parent link of a splay tree node, present only when the policy walks back up
+template <typename Node, bool Enabled>
+struct splay_tree_parent {
+	// Pointer to the parent
+	Node* m_parent = nullptr;
+};
+template <typename Node>
+struct splay_tree_parent<Node, false> {};
+
+// Subtree size of a splay tree node, present only in trees keeping order statistics
+template <bool Enabled>
+struct splay_tree_subtree_size {
+	// Number of nodes in the subtree rooted at this node, itself included
+	size_t m_subtree_size = 1;
+};
+template <>
+struct splay_tree_subtree_size<false> {};
+
+// With CacheHash, every node also has room for the full hash of its key,
+// which a hash container keeping its buckets in splay trees fills in and
+// reads back when it moves nodes between buckets; the tree never touches it
+// With InlineValue, nodes hold V itself instead of a std::unique_ptr to it,
+// see value_storage.hpp and inline_splay_tree below
+// With OrderStatistics, every node also counts the nodes of its subtree,
+// kept up to date through every rotation, insert and extract, for rank,
+// select and count_range; without it they do not compile and cost nothing
+template <typename K, typename V, typename Splay = bottom_up_splay, bool CacheHash = false, bool InlineValue = false, bool OrderStatistics = false>
 class splay_tree {
+	using storage = value_storage<V, InlineValue>;
 public:
-	struct splay_tree_node {
+	// What a node holds and extract returns: std::unique_ptr<V>, or V with InlineValue
+	using holder = typename storage::holder;
+	// What peek returns: const std::unique_ptr<V>&, or V& with InlineValue
+	using reference = typename storage::reference;
+	using const_reference = typename storage::const_reference;
+
+	struct splay_tree_node : splay_tree_parent<splay_tree_node, !Splay::top_down>, cached_hash<CacheHash>,
+			splay_tree_subtree_size<OrderStatistics> {
 		// Pointer to the left child
-		std::shared_ptr<splay_tree_node> m_left {};
+		splay_tree_node* m_left = nullptr;
 		// Pointer to the right child
-		std::shared_ptr<splay_tree_node> m_right {};
-		// Weak pointer to the parent
-		std::weak_ptr<splay_tree_node> m_parent {};
+		splay_tree_node* m_right = nullptr;
 
 		// The key of this element
 		K m_key {};
-		// Pointer to the value of this element
-		std::unique_ptr<V> m_value {};
+		// The value of this element, or a pointer to it
+		holder m_value {};
 	};
 
+	// Allocator the nodes of a tree are created in
+	using arena_type = node_arena<splay_tree_node>;
+
+	// Bidirectional iterator over the nodes in key order, whose m_key and
+	// m_value are the elements; it walks parent links and never restructures
+	// the tree, so it is only available with policies that keep them
+	// Splaying moves nodes around without changing their order, so an
+	// iterator stays valid until its own node is extracted
+	template <typename Node>
+	class tree_iterator {
+	public:
+		using iterator_category = std::bidirectional_iterator_tag;
+		using value_type = splay_tree_node;
+		using difference_type = std::ptrdiff_t;
+		using pointer = Node*;
+		using reference = Node&;
+
+		tree_iterator() = default;
+		tree_iterator(Node* node, const splay_tree* tree) : m_node(node), m_tree(tree) {}
+		// Iterators convert to const iterators
+		operator tree_iterator<const splay_tree_node>() const { return { m_node, m_tree }; }
+
+		reference operator*() const { return *m_node; }
+		pointer operator->() const { return m_node; }
+		tree_iterator& operator++() {
+			m_node = next_node(m_node);
+			return *this;
+		}
+		tree_iterator operator++(int) {
+			tree_iterator old = *this;
+			++*this;
+			return old;
+		}
+		// Decrementing end() gives the maximum
+		tree_iterator& operator--() {
+			m_node = m_node == nullptr ? rightmost(static_cast<Node*>(m_tree->m_root)) : previous_node(m_node);
+			return *this;
+		}
+		tree_iterator operator--(int) {
+			tree_iterator old = *this;
+			--*this;
+			return old;
+		}
+		bool operator==(const tree_iterator& other) const { return m_node == other.m_node; }
+		bool operator!=(const tree_iterator& other) const { return m_node != other.m_node; }
+
+	private:
+		// The current node, or nullptr past the end
+		Node* m_node = nullptr;
+		// The tree, whose root end() has to decrement from
+		const splay_tree* m_tree = nullptr;
+	};
+	using iterator = tree_iterator<splay_tree_node>;
+	using const_iterator = tree_iterator<const splay_tree_node>;
+
 	// Return a pointer to the root of the tree
-	std::shared_ptr<splay_tree_node> get_root() const;
+	const splay_tree_node* get_root() const;
 
-	// Default constructor - create an empty splay tree
+	// Default constructor - create an empty splay tree that owns its node arena
 	splay_tree();
-    
+	// Constructor - create an empty splay tree whose nodes live in arena, which
+	// may be shared with other trees and must outlive them
+	explicit splay_tree(arena_type& arena);
+	// Trees own their nodes, so they can be moved but not copied
+	splay_tree(splay_tree&& other) noexcept;
+	splay_tree& operator=(splay_tree&& other) noexcept;
+	splay_tree(const splay_tree&) = delete;
+	splay_tree& operator=(const splay_tree&) = delete;
+	// Destroy every node without recursion, then release an owned arena in bulk
+	~splay_tree();
+
     // Splays the input node to the root
-    void splay(std::shared_ptr<splay_tree_node> node);
-    
+    // Only available with bottom_up_splay, which keeps parent links
+    void splay(splay_tree_node* node);
+
     // Helper function for splay, rotates left
-    void rotate_left(std::shared_ptr<splay_tree_node> node);
-    
+    void rotate_left(splay_tree_node* node);
+
     // Helper function for splay, rotates right
-    void rotate_right(std::shared_ptr<splay_tree_node> node);
+    void rotate_right(splay_tree_node* node);
 
 	// Insert the key/value pair into the tree, if the key doesn't already exist
 	// Throw duplicate_key if the key already exists
+	// With InlineValue the value is moved out of its pointer, which must not
+	// be null, and std::invalid_argument is thrown if it is
 	void insert(const K& key, std::unique_ptr<V> value);
-	// Return a const reference to the value associated with the given key
+	// Insert key with a value constructed from args, and return the value
+	// Throw duplicate_key if the key already exists
+	template <typename... Args>
+	V& emplace(const K& key, Args&&... args);
+	// Same as emplace, but if the key already exists return its value and
+	// false without constructing anything
+	// The pointer is null only for a null value inserted by pointer
+	template <typename... Args>
+	std::pair<V*, bool> try_emplace(const K& key, Args&&... args);
+	// Return a reference to the value associated with the given key, or to
+	// its pointer without InlineValue
 	// Throw nonexistent_key if the key is not in the splay tree
-	const std::unique_ptr<V>& peek(const K& key);
+	reference peek(const K& key);
+	// Same as peek, but never restructures the tree, so concurrent readers
+	// may share it as long as nothing modifies it
+	const_reference peek(const K& key) const;
 	// Remove and return the key-value pair associated with the given key
 	// Throw nonexistent_key if the key is not in the splay tree
-	std::unique_ptr<V> extract(const K& key);
+	holder extract(const K& key);
+	// Same as peek and extract, for a key of another type Q that compares
+	// against K with < and > (such as std::string_view for std::string
+	// keys), so no K has to be constructed for the lookup
+	template <typename Q, typename = std::enable_if_t<is_heterogeneous_key<K,Q>::value>>
+	reference peek(const Q& key);
+	template <typename Q, typename = std::enable_if_t<is_heterogeneous_key<K,Q>::value>>
+	const_reference peek(const Q& key) const;
+	template <typename Q, typename = std::enable_if_t<is_heterogeneous_key<K,Q>::value>>
+	holder extract(const Q& key);
 
-	// Return the minimum key in the splay tree, and splay the node
+	// Return the node holding key, a K or a Q as above, restructuring the
+	// tree as the policy directs, or nullptr if the key is not in the tree
+	template <typename Q>
+	splay_tree_node* find_node(const Q& key);
+	// Same as find_node, but never restructures the tree
+	template <typename Q>
+	const splay_tree_node* find_node(const Q& key) const;
+
+	// Link a node created in this tree's arena, such as one released from
+	// another tree sharing it, into this one without reallocating it
+	// Throw duplicate_key if its key already exists, leaving the node with the caller
+	void insert_node(splay_tree_node* node);
+	// Detach every node from the tree, passing each one to release in turn,
+	// and leave the tree empty
+	template <typename F>
+	void release_nodes(F&& release);
+
+	// Insert the key-value pairs in [first, last), whose keys must be strictly
+	// increasing, moving each pair's second, a holder, into the tree, and
+	// rebuild the tree perfectly balanced: O(n + size()) time instead of the
+	// O(n log n) rotations of n inserts
+	// Throw std::invalid_argument if the keys are out of order, or
+	// duplicate_key if one already exists; either way the tree's contents and
+	// the range are unchanged
+	template <typename ForwardIt>
+	void build_from_sorted(ForwardIt first, ForwardIt last);
+	// Same as build_from_sorted, for count nodes created in this tree's arena
+	// and sorted by key, which stay with the caller if an exception is thrown
+	void insert_sorted_nodes(splay_tree_node* const* nodes, size_t count);
+
+	// Iterators over the elements in key order; see tree_iterator
+	iterator begin();
+	iterator end();
+	const_iterator begin() const;
+	const_iterator end() const;
+	// Return an iterator to the first element whose key is not less than
+	// key, a K or a Q as for find_node, or end() if there is none, and splay
+	// the node as the policy directs
+	template <typename Q>
+	iterator lower_bound(const Q& key);
+	// Return an iterator to the first element whose key is greater than key,
+	// or end() if there is none, and splay the node as the policy directs
+	template <typename Q>
+	iterator upper_bound(const Q& key);
+	// Same as lower_bound and upper_bound, but never restructure the tree
+	template <typename Q>
+	const_iterator lower_bound(const Q& key) const;
+	template <typename Q>
+	const_iterator upper_bound(const Q& key) const;
+	// Call visit(key, value), with value a reference as peek returns it, for
+	// every element whose key lies between lo and hi inclusive, in key
+	// order, and return how many there were
+	// The lower bound is splayed once and its successors are streamed from
+	// there, so this costs O(log n + k) for k elements rather than k lookups;
+	// top-down policies, lacking parent links, splay each successor up in
+	// turn instead, which splay trees also do in O(1) amortized per key
+	// visit must not modify the tree
+	template <typename Q, typename F>
+	size_t range(const Q& lo, const Q& hi, F&& visit);
+	// Call visit(key, value), with value a reference as the const peek
+	// returns it, for every element in key order, or with
+	// for_each_level_order breadth-first from the root, without
+	// restructuring the tree; both keep their pending nodes in a vector
+	// rather than recursing, so a degenerate tree of any depth is safe
+	template <typename F>
+	void for_each(F&& visit) const;
+	template <typename F>
+	void for_each_level_order(F&& visit) const;
+
+	// Move every element whose key is not less than key, a K or a Q as for
+	// find_node, into a new tree and return it, in O(log n) amortized time by
+	// splaying the boundary to the root and cutting the tree there
+	// The new tree creates nodes in the same arena, sharing ownership of it
+	// if this tree owns its arena, so the two can be joined again later
+	template <typename Q>
+	splay_tree split(const Q& key);
+	// Move every element of other, whose keys must all be greater than those
+	// of this tree, into this tree in O(log n) amortized time, leaving other
+	// empty; an empty tree takes over other's arena
+	// Throw std::invalid_argument if the key ranges overlap or the trees
+	// create nodes in different arenas, leaving their contents unchanged
+	void join(splay_tree& other);
+	// Move every element whose key lies between lo and hi inclusive into a
+	// new tree, as split does, and return it: two splits and a join, so
+	// O(log n) amortized however many elements move
+	template <typename Q>
+	splay_tree extract_range(const Q& lo, const Q& hi);
+
+	// Order statistics, only with OrderStatistics, each O(log n) amortized
+	// and splaying the last node reached as the policy directs
+	// Return the number of elements whose keys are less than key, a K or a Q as for find_node
+	template <typename Q>
+	size_t rank(const Q& key);
+	// Return the key of rank k, the (k + 1)-th smallest
+	// Throw std::out_of_range if k is not less than size()
+	K select(size_t k);
+	// Return the number of elements whose keys lie between lo and hi inclusive
+	template <typename Q>
+	size_t count_range(const Q& lo, const Q& hi);
+
+	// Return the minimum key in the splay tree, and splay the node as the policy directs
 	// Throw empty_tree if the tree is empty
 	K minimum_key();
-	// Return the maximum key in the splay tree, and splay the node
+	// Return the maximum key in the splay tree, and splay the node as the policy directs
 	// Throw empty_tree if the tree is empty
 	K maximum_key();
 
-	// Return the current number of elements in the splay tree
-	bool empty() const;
 	// Return whether the splay tree is currently empty
+	bool empty() const;
+	// Return the current number of elements in the splay tree
+	// With OrderStatistics the size is always exact. Otherwise split, join
+	// and extract_range leave the sizes of the trees they cut up unknown:
+	// size() then counts the nodes in O(n) time on every call, without
+	// caching the count, so that concurrent const calls stay race-free,
+	// until the next insert or extract counts once and keeps the size
 	size_t size() const;
+	// Destroy every element, leaving the tree empty; an arena the tree owns
+	// alone is released in bulk, without visiting the nodes at all when
+	// they have nothing to destroy
+	void clear();
 
 private:
+	// Bodies of peek and extract, shared by the K and heterogeneous overloads
+	template <typename Q>
+	holder& peek_key(const Q& key);
+	template <typename Q>
+	const holder& peek_key(const Q& key) const;
+	template <typename Q>
+	holder extract_key(const Q& key);
+	// Create a node for key and value in the arena and link it in, returning it
+	// Throw duplicate_key if the key already exists
+	splay_tree_node* insert_value(const K& key, holder value);
+	// Return the in-order successor and predecessor of node through parent
+	// links, or nullptr if there is none
+	template <typename Node>
+	static Node* next_node(Node* node);
+	template <typename Node>
+	static Node* previous_node(Node* node);
+	// Return the leftmost and rightmost node of the subtree rooted at node,
+	// or nullptr if it is empty
+	template <typename Node>
+	static Node* leftmost(Node* node);
+	template <typename Node>
+	static Node* rightmost(Node* node);
+	// Descend to the first node whose key is not less than key, or with
+	// Upper greater than key, returning it or nullptr, and its depth in depth
+	template <bool Upper, typename Q>
+	splay_tree_node* bound_node(const Q& key, size_t& depth) const;
+	// Turn the root's successor into the root, with the old root as its left
+	// child, by top-down splaying the minimum of the right subtree; return
+	// false if the root is the maximum
+	bool splay_successor_to_root();
+	// Return an empty tree creating nodes in the same arena as this one
+	splay_tree sibling() const;
+	// Move the elements whose keys are not less than key, or with Upper
+	// greater than key, into a new tree and return it
+	template <bool Upper, typename Q>
+	splay_tree split_off(const Q& key);
+	// Add delta to m_size after an insert or extract, or count the nodes
+	// again if it is unknown
+	void adjust_size(std::ptrdiff_t delta);
+	// Return the number of nodes in the subtree rooted at node, which may be
+	// nullptr; only with OrderStatistics
+	static size_t subtree_size(const splay_tree_node* node);
+	// Recompute the subtree size of node from its children's, if they are kept
+	static void update_subtree_size(splay_tree_node* node);
+	// Return the number of keys less than key, or with Upper not greater
+	// than key, and splay the last node reached as the policy directs
+	template <bool Upper, typename Q>
+	size_t count_below(const Q& key);
+	// Count the nodes with a stack as deep as the tree, without restructuring it
+	size_t count_nodes() const;
+	// Ask the policy what to do with node, reached at depth, and do it
+	void restructure(splay_tree_node* node, size_t depth);
+	// Semi-splay node: in the zig-zig case rotate only the parent above the
+	// grandparent and continue from the parent
+	void semi_splay_up(splay_tree_node* node);
+	// Top-down splay of the subtree rooted at node: descend in the direction
+	// given by direction(current), which is negative for left, positive for
+	// right and zero to stop, splitting the path into left and right trees
+	// as it goes, then reassemble them under the last node reached and
+	// return it as the new subtree root
+	template <typename Direction>
+	static splay_tree_node* splay_down(splay_tree_node* node, Direction direction);
+	// Top-down splay of the subtree rooted at node towards key
+	template <typename Q>
+	static splay_tree_node* splay_down_to(splay_tree_node* node, const Q& key);
+	// Link node under the root, which a top-down splay towards node's key
+	// has just produced, and make node the new root
+	void attach_at_root(splay_tree_node* node);
+
+	// Throw std::invalid_argument if next does not follow previous, or
+	// duplicate_key if they are equal
+	static void check_sorted(const K& previous, const K& next);
+	// Create nodes for the count pairs from current on, advancing it, and
+	// link them into a perfectly balanced subtree, returning its root
+	// Nodes are created and written in key order in a single pass, and
+	// recursion is only log count deep; if creating a node throws, the nodes
+	// of the subtree are destroyed again
+	template <typename ForwardIt>
+	splay_tree_node* build_balanced(ForwardIt& current, size_t count);
+	// Link the count nodes at nodes, sorted by key, into a perfectly balanced
+	// subtree below parent and return its root
+	static splay_tree_node* link_balanced(splay_tree_node* const* nodes, size_t count, splay_tree_node* parent);
+
+	// Return the arena new nodes are created in, creating an owned one on first use
+	arena_type& arena();
+	// Destroy every node, flattening the tree with rotations instead of recursing
+	void destroy_nodes();
+	// Same for the subtree rooted at node, which is left dangling
+	void destroy_subtree(splay_tree_node* node);
+
+	// m_size of a tree whose nodes have not been counted since a split or join
+	static constexpr size_t unknown_size = static_cast<size_t>(-1);
+
 	// Pointer to the root node of the splay tree
-	std::shared_ptr<splay_tree_node> m_root {};
-    // Current size of the splay tree
+	splay_tree_node* m_root = nullptr;
+	// Current size of the splay tree, or unknown_size
 	size_t m_size = 0;
+	// The arena nodes are created in, either m_own_arena or one shared with other trees
+	arena_type* m_arena = nullptr;
+	// The arena of a tree that was not given one, created on first insert
+	// and shared with the trees split off from it
+	std::shared_ptr<arena_type> m_own_arena {};
+	// The splay policy, which may keep per-tree state
+	Splay m_policy {};
 };
 
-template <typename K, typename V>
-std::shared_ptr<typename splay_tree<K,V>::splay_tree_node> splay_tree<K,V>::get_root() const {
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+const typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::splay_tree_node* splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::get_root() const {
 	return m_root;
 }
 
-template <typename K, typename V>
-splay_tree<K,V>::splay_tree() {
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::splay_tree() {
 	m_root = nullptr;
 }
-    
-template <typename K, typename V>
-void splay_tree<K,V>::splay(std::shared_ptr<splay_tree_node> node) {
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::splay_tree(arena_type& arena) {
+	m_root = nullptr;
+    m_arena = &arena;
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::splay_tree(splay_tree&& other) noexcept
+    : m_root(other.m_root), m_size(other.m_size), m_arena(other.m_arena),
+      m_own_arena(std::move(other.m_own_arena)), m_policy(other.m_policy) {
+    other.m_root = nullptr;
+    other.m_size = 0;
+    if (m_own_arena != nullptr) {
+        other.m_arena = nullptr;
+    }
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>& splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::operator=(splay_tree&& other) noexcept {
+    if (this != &other) {
+        destroy_nodes();
+        m_root = other.m_root;
+        m_size = other.m_size;
+        m_arena = other.m_arena;
+        m_own_arena = std::move(other.m_own_arena);
+        m_policy = other.m_policy;
+        other.m_root = nullptr;
+        other.m_size = 0;
+        if (m_own_arena != nullptr) {
+            other.m_arena = nullptr;
+        }
+    }
+    return *this;
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::~splay_tree() {
+    destroy_nodes();
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::arena_type& splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::arena() {
+    if (m_arena == nullptr) {
+        m_own_arena = std::make_shared<arena_type>();
+        m_arena = m_own_arena.get();
+    }
+    return *m_arena;
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+void splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::destroy_nodes() {
+    // Trees split off from this one may still have nodes in a shared arena
+    bool releaseArena = m_own_arena != nullptr && m_own_arena.use_count() == 1;
+    if (!std::is_trivially_destructible_v<splay_tree_node> || !releaseArena) {
+        destroy_subtree(m_root);
+    }
+    m_root = nullptr;
+    m_size = 0;
+    if (releaseArena) {
+        m_own_arena->clear();
+    }
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+void splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::destroy_subtree(splay_tree_node* node) {
+    splay_tree_node* current = node;
+    while (current != nullptr) {
+        if (current->m_left != nullptr) {
+            // Rotate the left child up so the leftmost node ends up on top
+            splay_tree_node* left = current->m_left;
+            current->m_left = left->m_right;
+            left->m_right = current;
+            current = left;
+        } else {
+            splay_tree_node* right = current->m_right;
+            m_arena->destroy(current);
+            current = right;
+        }
+    }
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+void splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::splay(splay_tree_node* node) {
     while (node != m_root) {
-        std::shared_ptr<splay_tree_node> parent = node->m_parent.lock();
-        std::shared_ptr<splay_tree_node> grandparent = parent->m_parent.lock();
+        splay_tree_node* parent = node->m_parent;
+        splay_tree_node* grandparent = parent->m_parent;
         if (parent == m_root) {
             if (parent->m_left == node) {
                 rotate_right(parent);
@@ -115,219 +581,1168 @@ void splay_tree<K,V>::splay(std::shared_ptr<splay_tree_node> node) {
     m_root = node;
 }
 
-template <typename K, typename V>
-void splay_tree<K,V>::rotate_left(std::shared_ptr<splay_tree_node> node) {
-    std::shared_ptr<splay_tree_node> parent = node->m_parent.lock();
-    std::shared_ptr<splay_tree_node> rightChild = node->m_right;
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+void splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::rotate_left(splay_tree_node* node) {
+    splay_tree_node* parent = node->m_parent;
+    splay_tree_node* rightChild = node->m_right;
+    rightChild->m_parent = parent;
     if (node != m_root) {
-        rightChild->m_parent = parent;
-        if (rightChild->m_key < parent->m_key) {
-            parent->m_left = rightChild;    
+        if (parent->m_left == node) {
+            parent->m_left = rightChild;
         } else {
-            parent->m_right = rightChild;    
+            parent->m_right = rightChild;
         }
     } else {
-        rightChild->m_parent.reset();
         m_root = rightChild;
     }
+    node->m_right = rightChild->m_left;
     if (rightChild->m_left != nullptr) {
-        node->m_right = rightChild->m_left;
         rightChild->m_left->m_parent = node;
-    } else {
-        node->m_right = nullptr;    
     }
     rightChild->m_left = node;
     node->m_parent = rightChild;
+    update_subtree_size(node);
+    update_subtree_size(rightChild);
 }
 
-template <typename K, typename V>
-void splay_tree<K,V>::rotate_right(std::shared_ptr<splay_tree_node> node) {
-    std::shared_ptr<splay_tree_node> parent = node->m_parent.lock();
-    std::shared_ptr<splay_tree_node> leftChild = node->m_left;
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+void splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::rotate_right(splay_tree_node* node) {
+    splay_tree_node* parent = node->m_parent;
+    splay_tree_node* leftChild = node->m_left;
+    leftChild->m_parent = parent;
     if (node != m_root) {
-        leftChild->m_parent = parent;
-        if (leftChild->m_key < parent->m_key) {
-            parent->m_left = leftChild;    
+        if (parent->m_left == node) {
+            parent->m_left = leftChild;
         } else {
-            parent->m_right = leftChild;    
+            parent->m_right = leftChild;
         }
     } else {
-        leftChild->m_parent.reset();
         m_root = leftChild;
     }
+    node->m_left = leftChild->m_right;
     if (leftChild->m_right != nullptr) {
-        node->m_left = leftChild->m_right;
         leftChild->m_right->m_parent = node;
-    } else {
-        node->m_left = nullptr;    
     }
     leftChild->m_right = node;
     node->m_parent = leftChild;
+    update_subtree_size(node);
+    update_subtree_size(leftChild);
 }
 
-template <typename K, typename V>
-void splay_tree<K,V>::insert(const K& key, std::unique_ptr<V> value) {
-    if (m_root == nullptr) {
-        m_root = std::make_shared<splay_tree_node>();
-        m_root->m_key = key;
-        m_root->m_value = std::move(value);
-        m_root->m_parent.reset();
-        m_size++;
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+void splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::restructure(splay_tree_node* node, size_t depth) {
+    if (node == m_root) {
         return;
+    }
+    switch (m_policy.on_access(depth)) {
+    case splay_action::splay:
+        splay(node);
+        break;
+    case splay_action::semi_splay:
+        semi_splay_up(node);
+        break;
+    case splay_action::none:
+        break;
+    }
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+void splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::semi_splay_up(splay_tree_node* node) {
+    while (node != m_root) {
+        splay_tree_node* parent = node->m_parent;
+        splay_tree_node* grandparent = parent->m_parent;
+        if (parent == m_root) {
+            if (parent->m_left == node) {
+                rotate_right(parent);
+            } else {
+                rotate_left(parent);
+            }
+        } else if (grandparent->m_left == parent && parent->m_left == node) {
+            rotate_right(grandparent);
+            node = parent;
+        } else if (grandparent->m_right == parent && parent->m_right == node) {
+            rotate_left(grandparent);
+            node = parent;
+        } else if (parent->m_right == node) {
+            rotate_left(parent);
+            rotate_right(grandparent);
+        } else {
+            rotate_right(parent);
+            rotate_left(grandparent);
+        }
+    }
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename Direction>
+typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::splay_tree_node* splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::splay_down(
+        splay_tree_node* node, Direction direction) {
+    // Roots of the trees of nodes known to be smaller and larger than the
+    // target, and the empty child slots where the next such node is hooked
+    splay_tree_node* leftRoot = nullptr;
+    splay_tree_node* rightRoot = nullptr;
+    splay_tree_node** leftHook = &leftRoot;
+    splay_tree_node** rightHook = &rightRoot;
+    // With OrderStatistics, the sizes the left and right trees will have
+    size_t leftSize = 0;
+    size_t rightSize = 0;
+    while (true) {
+        int step = direction(node);
+        if (step < 0) {
+            if (node->m_left == nullptr) {
+                break;
+            }
+            if (direction(node->m_left) < 0) {
+                // Zig-zig: rotate right before linking
+                splay_tree_node* leftChild = node->m_left;
+                node->m_left = leftChild->m_right;
+                leftChild->m_right = node;
+                update_subtree_size(node);
+                node = leftChild;
+                if (node->m_left == nullptr) {
+                    break;
+                }
+            }
+            *rightHook = node;
+            rightHook = &node->m_left;
+            if constexpr (OrderStatistics) {
+                rightSize += 1 + subtree_size(node->m_right);
+            }
+            node = node->m_left;
+        } else if (step > 0) {
+            if (node->m_right == nullptr) {
+                break;
+            }
+            if (direction(node->m_right) > 0) {
+                // Zag-zag: rotate left before linking
+                splay_tree_node* rightChild = node->m_right;
+                node->m_right = rightChild->m_left;
+                rightChild->m_left = node;
+                update_subtree_size(node);
+                node = rightChild;
+                if (node->m_right == nullptr) {
+                    break;
+                }
+            }
+            *leftHook = node;
+            leftHook = &node->m_right;
+            if constexpr (OrderStatistics) {
+                leftSize += 1 + subtree_size(node->m_left);
+            }
+            node = node->m_right;
+        } else {
+            break;
+        }
+    }
+    if constexpr (OrderStatistics) {
+        // The nodes linked into the left tree form its right spine, each
+        // holding what was linked after it, and likewise on the right, so
+        // their sizes count down from the trees' totals (Sleator's method)
+        leftSize += subtree_size(node->m_left);
+        rightSize += subtree_size(node->m_right);
+        node->m_subtree_size = leftSize + rightSize + 1;
+        *leftHook = nullptr;
+        *rightHook = nullptr;
+        for (splay_tree_node* linked = leftRoot; linked != nullptr; linked = linked->m_right) {
+            linked->m_subtree_size = leftSize;
+            leftSize -= 1 + subtree_size(linked->m_left);
+        }
+        for (splay_tree_node* linked = rightRoot; linked != nullptr; linked = linked->m_left) {
+            linked->m_subtree_size = rightSize;
+            rightSize -= 1 + subtree_size(linked->m_right);
+        }
+    }
+    *leftHook = node->m_left;
+    *rightHook = node->m_right;
+    node->m_left = leftRoot;
+    node->m_right = rightRoot;
+    return node;
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename Q>
+typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::splay_tree_node* splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::splay_down_to(
+        splay_tree_node* node, const Q& key) {
+    return splay_down(node, [&key](const splay_tree_node* current) {
+        if (key < current->m_key) {
+            return -1;
+        }
+        if (key > current->m_key) {
+            return 1;
+        }
+        return 0;
+    });
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+void splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::attach_at_root(splay_tree_node* node) {
+    if (m_root != nullptr) {
+        if (node->m_key < m_root->m_key) {
+            node->m_left = m_root->m_left;
+            node->m_right = m_root;
+            m_root->m_left = nullptr;
+        } else {
+            node->m_right = m_root->m_right;
+            node->m_left = m_root;
+            m_root->m_right = nullptr;
+        }
+        update_subtree_size(m_root);
+    }
+    update_subtree_size(node);
+    m_root = node;
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+void splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::insert(const K& key, std::unique_ptr<V> value) {
+    insert_value(key, storage::from_pointer(std::move(value)));
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename... Args>
+V& splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::emplace(const K& key, Args&&... args) {
+    return *storage::get(insert_value(key, storage::make(std::forward<Args>(args)...))->m_value);
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename... Args>
+std::pair<V*, bool> splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::try_emplace(const K& key, Args&&... args) {
+    splay_tree_node* existing = find_node(key);
+    if (existing != nullptr) {
+        return { storage::get(existing->m_value), false };
+    }
+    // The search left the tree splayed towards key, so linking it is cheap
+    return { storage::get(insert_value(key, storage::make(std::forward<Args>(args)...))->m_value), true };
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::splay_tree_node* splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::insert_value(
+        const K& key, holder value) {
+    splay_tree_node* newNode = arena().create();
+    // A key that fails to copy or compare, or is already there, leaves the
+    // tree as it was and the node destroyed
+    try {
+        newNode->m_key = key;
+        newNode->m_value = std::move(value);
+        insert_node(newNode);
+    } catch (...) {
+        m_arena->destroy(newNode);
+        throw;
+    }
+    return newNode;
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::reference splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::peek(const K& key) {
+    return peek_key(key);
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::const_reference splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::peek(const K& key) const {
+    return peek_key(key);
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::holder splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::extract(const K& key) {
+    return extract_key(key);
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename Q, typename>
+typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::reference splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::peek(const Q& key) {
+    return peek_key(key);
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename Q, typename>
+typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::const_reference splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::peek(const Q& key) const {
+    return peek_key(key);
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename Q, typename>
+typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::holder splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::extract(const Q& key) {
+    return extract_key(key);
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename Q>
+typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::holder& splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::peek_key(const Q& key) {
+    splay_tree_node* node = find_node(key);
+    if (node == nullptr) {
+        throw nonexistent_key();
+    }
+    return node->m_value;
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename Q>
+const typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::holder& splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::peek_key(const Q& key) const {
+    const splay_tree_node* node = find_node(key);
+    if (node == nullptr) {
+        throw nonexistent_key();
+    }
+    return node->m_value;
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename Q>
+typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::splay_tree_node* splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::find_node(const Q& key) {
+    if (m_root == nullptr) {
+        return nullptr;
+    } else if constexpr (Splay::top_down) {
+        m_root = splay_down_to(m_root, key);
+        if (key < m_root->m_key || key > m_root->m_key) {
+            return nullptr;
+        }
+        return m_root;
     } else {
-        std::shared_ptr<splay_tree_node> current = m_root;
-        std::shared_ptr<splay_tree_node> parent = current;
+        splay_tree_node* current = m_root;
+        size_t depth = 0;
         while (current != nullptr) {
-            parent = current;
             if (key < current->m_key) {
-                current = current->m_left;    
+                current = current->m_left;
             } else if (key > current->m_key) {
-                current = current->m_right;    
+                current = current->m_right;
             } else {
-                throw duplicate_key();    
-            }  
+                restructure(current, depth);
+                return current;
+            }
+            depth++;
         }
-        std::shared_ptr<splay_tree_node> newNode = std::make_shared<splay_tree_node>();
-        newNode->m_key = key;
-        newNode->m_value = std::move(value);
-        newNode->m_parent = parent;
-        if (key < parent->m_key) {
-            parent->m_left = newNode;    
+        return nullptr;
+    }
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename Q>
+const typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::splay_tree_node* splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::find_node(const Q& key) const {
+    const splay_tree_node* current = m_root;
+    while (current != nullptr) {
+        if (key < current->m_key) {
+            current = current->m_left;
+        } else if (key > current->m_key) {
+            current = current->m_right;
         } else {
-            parent->m_right = newNode;
+            return current;
         }
-        m_size++;
-        splay(newNode);
     }
+    return nullptr;
 }
 
-template <typename K, typename V>
-const std::unique_ptr<V>& splay_tree<K,V>::peek(const K& key) {
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename Q>
+typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::holder splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::extract_key(const Q& key) {
     if (m_root == nullptr) {
         throw nonexistent_key();
+    }
+    if constexpr (Splay::top_down) {
+        m_root = splay_down_to(m_root, key);
+        if (key < m_root->m_key || key > m_root->m_key) {
+            throw nonexistent_key();
+        }
+        splay_tree_node* removed = m_root;
+        if (removed->m_left == nullptr) {
+            m_root = removed->m_right;
+        } else {
+            // Every key on the left is smaller, so this brings its maximum up
+            // with an empty right subtree to hang the removed node's right on
+            m_root = splay_down_to(removed->m_left, key);
+            m_root->m_right = removed->m_right;
+            update_subtree_size(m_root);
+        }
+        adjust_size(-1);
+        holder value = std::move(removed->m_value);
+        m_arena->destroy(removed);
+        return value;
     } else {
-        std::shared_ptr<splay_tree_node> current = m_root;
+        splay_tree_node* current = m_root;
         while (current != nullptr) {
             if (key < current->m_key) {
-                current = current->m_left;    
+                current = current->m_left;
             } else if (key > current->m_key) {
-                current = current->m_right;    
+                current = current->m_right;
             } else {
-                if (current != m_root) {
-                    splay(current);
+                break;
+            }
+        }
+        if (current == nullptr) {
+            throw nonexistent_key();
+        }
+        if (current != m_root) {
+            splay(current);
+        }
+        if (current->m_right == nullptr) {
+            m_root = current->m_left;
+        } else if (current->m_left == nullptr) {
+            m_root = current->m_right;
+        } else {
+            splay_tree_node* successor = current->m_right;
+            while (successor->m_left != nullptr) {
+                successor = successor->m_left;
+            }
+            if (successor != current->m_right) {
+                splay_tree_node* successorParent = successor->m_parent;
+                if constexpr (OrderStatistics) {
+                    for (splay_tree_node* ancestor = successorParent; ancestor != current; ancestor = ancestor->m_parent) {
+                        ancestor->m_subtree_size--;
+                    }
+                }
+                successorParent->m_left = successor->m_right;
+                if (successor->m_right != nullptr) {
+                    successor->m_right->m_parent = successorParent;
                 }
-                return current->m_value;
-            }  
+                successor->m_right = current->m_right;
+                current->m_right->m_parent = successor;
+            }
+            successor->m_left = current->m_left;
+            current->m_left->m_parent = successor;
+            update_subtree_size(successor);
+            m_root = successor;
         }
-        throw nonexistent_key();
+        if (m_root != nullptr) {
+            m_root->m_parent = nullptr;
+        }
+        adjust_size(-1);
+        holder value = std::move(current->m_value);
+        m_arena->destroy(current);
+        return value;
+    }
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+void splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::insert_node(splay_tree_node* node) {
+    node->m_left = nullptr;
+    node->m_right = nullptr;
+    update_subtree_size(node);
+    if constexpr (Splay::top_down) {
+        if (m_root != nullptr) {
+            m_root = splay_down_to(m_root, node->m_key);
+            if (!(node->m_key < m_root->m_key) && !(node->m_key > m_root->m_key)) {
+                throw duplicate_key();
+            }
+        }
+        attach_at_root(node);
+        adjust_size(1);
+    } else {
+        node->m_parent = nullptr;
+        if (m_root == nullptr) {
+            m_root = node;
+            adjust_size(1);
+            return;
+        }
+        splay_tree_node* current = m_root;
+        splay_tree_node* parent = current;
+        size_t depth = 0;
+        while (current != nullptr) {
+            parent = current;
+            if (node->m_key < current->m_key) {
+                current = current->m_left;
+            } else if (node->m_key > current->m_key) {
+                current = current->m_right;
+            } else {
+                throw duplicate_key();
+            }
+            depth++;
+        }
+        node->m_parent = parent;
+        if (node->m_key < parent->m_key) {
+            parent->m_left = node;
+        } else {
+            parent->m_right = node;
+        }
+        if constexpr (OrderStatistics) {
+            for (splay_tree_node* ancestor = parent; ancestor != nullptr; ancestor = ancestor->m_parent) {
+                ancestor->m_subtree_size++;
+            }
+        }
+        adjust_size(1);
+        restructure(node, depth);
     }
 }
 
-template <typename K, typename V>
-std::unique_ptr<V> splay_tree<K,V>::extract(const K& key) {
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename F>
+void splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::release_nodes(F&& release) {
+    // Detach the leftmost node each time, rotating left children up first,
+    // so no stack is needed however deep the tree is
+    splay_tree_node* current = m_root;
+    m_root = nullptr;
+    m_size = 0;
+    while (current != nullptr) {
+        if (current->m_left != nullptr) {
+            splay_tree_node* left = current->m_left;
+            current->m_left = left->m_right;
+            left->m_right = current;
+            current = left;
+        } else {
+            splay_tree_node* right = current->m_right;
+            current->m_right = nullptr;
+            if constexpr (!Splay::top_down) {
+                current->m_parent = nullptr;
+            }
+            release(current);
+            current = right;
+        }
+    }
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename ForwardIt>
+void splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::build_from_sorted(ForwardIt first, ForwardIt last) {
+    // Reject a bad range before anything is built
+    if (first != last) {
+        for (ForwardIt previous = first, current = std::next(first); current != last; previous = current++) {
+            check_sorted(previous->first, current->first);
+        }
+    }
+    size_t count = static_cast<size_t>(std::distance(first, last));
     if (m_root == nullptr) {
-        throw nonexistent_key();
+        m_root = build_balanced(first, count);
+        m_size = count;
+        return;
+    }
+    // Otherwise the old nodes have to be merged in, which needs the new ones
+    // at hand as well
+    std::vector<splay_tree_node*> nodes;
+    nodes.reserve(count);
+    ForwardIt current = first;
+    try {
+        for (; current != last; ++current) {
+            splay_tree_node* node = arena().create();
+            nodes.push_back(node);
+            // Value first, so a key that fails to copy leaves it to be moved back
+            node->m_value = std::move(current->second);
+            node->m_key = current->first;
+        }
+        insert_sorted_nodes(nodes.data(), nodes.size());
+    } catch (...) {
+        for (splay_tree_node* node : nodes) {
+            first->second = std::move(node->m_value);
+            m_arena->destroy(node);
+            ++first;
+        }
+        throw;
+    }
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename ForwardIt>
+typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::splay_tree_node* splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::build_balanced(
+        ForwardIt& current, size_t count) {
+    if (count == 0) {
+        return nullptr;
+    }
+    size_t middle = count / 2;
+    splay_tree_node* left = build_balanced(current, middle);
+    splay_tree_node* root = nullptr;
+    try {
+        root = arena().create();
+        root->m_left = left;
+        root->m_key = current->first;
+        root->m_value = std::move(current->second);
+        ++current;
+        root->m_right = build_balanced(current, count - middle - 1);
+    } catch (...) {
+        destroy_subtree(root != nullptr ? root : left);
+        throw;
+    }
+    if constexpr (!Splay::top_down) {
+        if (root->m_left != nullptr) {
+            root->m_left->m_parent = root;
+        }
+        if (root->m_right != nullptr) {
+            root->m_right->m_parent = root;
+        }
+    }
+    update_subtree_size(root);
+    return root;
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+void splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::check_sorted(const K& previous, const K& next) {
+    if (!(previous < next)) {
+        if (!(previous > next)) {
+            throw duplicate_key();
+        }
+        throw std::invalid_argument("Keys not sorted!");
+    }
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+void splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::insert_sorted_nodes(splay_tree_node* const* nodes, size_t count) {
+    for (size_t i = 1; i < count; i++) {
+        check_sorted(nodes[i - 1]->m_key, nodes[i]->m_key);
+    }
+    if (m_root == nullptr) {
+        m_root = link_balanced(nodes, count, nullptr);
+        m_size = count;
+        return;
+    }
+    std::vector<splay_tree_node*> existing;
+    existing.reserve(size());
+    std::vector<splay_tree_node*> merged;
+    merged.reserve(size() + count);
+    release_nodes([&existing](splay_tree_node* node) { existing.push_back(node); });
+    size_t i = 0;
+    size_t j = 0;
+    while (i < existing.size() && j < count) {
+        if (existing[i]->m_key < nodes[j]->m_key) {
+            merged.push_back(existing[i++]);
+        } else if (existing[i]->m_key > nodes[j]->m_key) {
+            merged.push_back(nodes[j++]);
+        } else {
+            // Put the old nodes back, balanced, before giving up
+            m_root = link_balanced(existing.data(), existing.size(), nullptr);
+            m_size = existing.size();
+            throw duplicate_key();
+        }
+    }
+    merged.insert(merged.end(), existing.begin() + i, existing.end());
+    merged.insert(merged.end(), nodes + j, nodes + count);
+    m_root = link_balanced(merged.data(), merged.size(), nullptr);
+    m_size = merged.size();
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::splay_tree_node* splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::link_balanced(
+        splay_tree_node* const* nodes, size_t count, [[maybe_unused]] splay_tree_node* parent) {
+    if (count == 0) {
+        return nullptr;
+    }
+    size_t middle = count / 2;
+    splay_tree_node* root = nodes[middle];
+    // Link the left subtree before writing to root, so nodes are written in
+    // key order, which is usually also their order in the arena
+    splay_tree_node* left = link_balanced(nodes, middle, root);
+    if constexpr (!Splay::top_down) {
+        root->m_parent = parent;
+    }
+    root->m_left = left;
+    root->m_right = link_balanced(nodes + middle + 1, count - middle - 1, root);
+    update_subtree_size(root);
+    return root;
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename Node>
+Node* splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::next_node(Node* node) {
+    static_assert(!Splay::top_down, "iterating needs the parent links top-down policies do without");
+    if (node->m_right != nullptr) {
+        return leftmost(node->m_right);
+    }
+    Node* parent = node->m_parent;
+    while (parent != nullptr && parent->m_right == node) {
+        node = parent;
+        parent = parent->m_parent;
+    }
+    return parent;
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename Node>
+Node* splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::previous_node(Node* node) {
+    static_assert(!Splay::top_down, "iterating needs the parent links top-down policies do without");
+    if (node->m_left != nullptr) {
+        return rightmost(node->m_left);
+    }
+    Node* parent = node->m_parent;
+    while (parent != nullptr && parent->m_left == node) {
+        node = parent;
+        parent = parent->m_parent;
+    }
+    return parent;
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename Node>
+Node* splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::leftmost(Node* node) {
+    if (node != nullptr) {
+        while (node->m_left != nullptr) {
+            node = node->m_left;
+        }
+    }
+    return node;
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename Node>
+Node* splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::rightmost(Node* node) {
+    if (node != nullptr) {
+        while (node->m_right != nullptr) {
+            node = node->m_right;
+        }
+    }
+    return node;
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::iterator splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::begin() {
+    return iterator(leftmost(m_root), this);
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::iterator splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::end() {
+    return iterator(nullptr, this);
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::const_iterator splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::begin() const {
+    return const_iterator(leftmost(static_cast<const splay_tree_node*>(m_root)), this);
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::const_iterator splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::end() const {
+    return const_iterator(nullptr, this);
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <bool Upper, typename Q>
+typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::splay_tree_node* splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::bound_node(
+        const Q& key, size_t& depth) const {
+    splay_tree_node* current = m_root;
+    splay_tree_node* bound = nullptr;
+    size_t currentDepth = 0;
+    while (current != nullptr) {
+        if (Upper ? key < current->m_key : !(key > current->m_key)) {
+            bound = current;
+            depth = currentDepth;
+            current = current->m_left;
+        } else {
+            current = current->m_right;
+        }
+        currentDepth++;
+    }
+    return bound;
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename Q>
+typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::iterator splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::lower_bound(const Q& key) {
+    size_t depth = 0;
+    splay_tree_node* node = bound_node<false>(key, depth);
+    if constexpr (!Splay::top_down) {
+        if (node != nullptr) {
+            restructure(node, depth);
+        }
+    }
+    return iterator(node, this);
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename Q>
+typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::iterator splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::upper_bound(const Q& key) {
+    size_t depth = 0;
+    splay_tree_node* node = bound_node<true>(key, depth);
+    if constexpr (!Splay::top_down) {
+        if (node != nullptr) {
+            restructure(node, depth);
+        }
+    }
+    return iterator(node, this);
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename Q>
+typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::const_iterator splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::lower_bound(const Q& key) const {
+    size_t depth = 0;
+    return const_iterator(bound_node<false>(key, depth), this);
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename Q>
+typename splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::const_iterator splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::upper_bound(const Q& key) const {
+    size_t depth = 0;
+    return const_iterator(bound_node<true>(key, depth), this);
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+bool splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::splay_successor_to_root() {
+    if (m_root->m_right == nullptr) {
+        return false;
+    }
+    splay_tree_node* successor = splay_down(m_root->m_right, [](const splay_tree_node*) { return -1; });
+    m_root->m_right = nullptr;
+    update_subtree_size(m_root);
+    successor->m_left = m_root;
+    update_subtree_size(successor);
+    m_root = successor;
+    return true;
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename Q, typename F>
+size_t splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::range(const Q& lo, const Q& hi, F&& visit) {
+    size_t count = 0;
+    if (m_root == nullptr) {
+        return 0;
+    } else if constexpr (Splay::top_down) {
+        // The splay leaves lo, its predecessor or its successor at the root
+        m_root = splay_down_to(m_root, lo);
+        if (lo > m_root->m_key && !splay_successor_to_root()) {
+            return 0;
+        }
+        do {
+            if (hi < m_root->m_key) {
+                break;
+            }
+            visit(m_root->m_key, static_cast<reference>(m_root->m_value));
+            count++;
+        } while (splay_successor_to_root());
+    } else {
+        for (iterator it = lower_bound(lo); it != end() && !(hi < it->m_key); ++it) {
+            visit(it->m_key, static_cast<reference>(it->m_value));
+            count++;
+        }
+    }
+    return count;
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename F>
+void splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::for_each(F&& visit) const {
+    std::vector<const splay_tree_node*> pending;
+    const splay_tree_node* node = m_root;
+    while (node != nullptr || !pending.empty()) {
+        // Walk down left children, leaving each node for after its left subtree
+        while (node != nullptr) {
+            pending.push_back(node);
+            node = node->m_left;
+        }
+        node = pending.back();
+        pending.pop_back();
+        visit(node->m_key, static_cast<const_reference>(node->m_value));
+        node = node->m_right;
+    }
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename F>
+void splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::for_each_level_order(F&& visit) const {
+    if (m_root == nullptr) {
+        return;
+    }
+    // The vector is the queue: nodes are appended and visited in order
+    std::vector<const splay_tree_node*> queue;
+    queue.push_back(m_root);
+    for (size_t next = 0; next < queue.size(); next++) {
+        const splay_tree_node* node = queue[next];
+        visit(node->m_key, static_cast<const_reference>(node->m_value));
+        if (node->m_left != nullptr) {
+            queue.push_back(node->m_left);
+        }
+        if (node->m_right != nullptr) {
+            queue.push_back(node->m_right);
+        }
+    }
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics> splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::sibling() const {
+    splay_tree tree;
+    tree.m_arena = m_arena;
+    tree.m_own_arena = m_own_arena;
+    return tree;
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <bool Upper, typename Q>
+splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics> splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::split_off(const Q& key) {
+    splay_tree larger = sibling();
+    if (m_root == nullptr) {
+        return larger;
+    }
+    if constexpr (Splay::top_down) {
+        // The splay leaves key, its predecessor or its successor at the root
+        m_root = splay_down_to(m_root, key);
+        if (Upper ? key < m_root->m_key : !(key > m_root->m_key)) {
+            larger.m_root = m_root;
+            m_root = m_root->m_left;
+            larger.m_root->m_left = nullptr;
+            update_subtree_size(larger.m_root);
+        } else {
+            larger.m_root = m_root->m_right;
+            m_root->m_right = nullptr;
+            update_subtree_size(m_root);
+        }
+    } else {
+        size_t depth = 0;
+        splay_tree_node* bound = bound_node<Upper>(key, depth);
+        if (bound == nullptr) {
+            return larger;
+        }
+        splay(bound);
+        larger.m_root = bound;
+        m_root = bound->m_left;
+        bound->m_left = nullptr;
+        update_subtree_size(bound);
+        if (m_root != nullptr) {
+            m_root->m_parent = nullptr;
+        }
+    }
+    if constexpr (OrderStatistics) {
+        larger.m_size = subtree_size(larger.m_root);
+        m_size = subtree_size(m_root);
+    } else if (larger.m_root == nullptr) {
+        larger.m_size = 0;
+    } else if (m_root == nullptr) {
+        larger.m_size = m_size;
+        m_size = 0;
+    } else {
+        // Counting either part would take as long as moving it node by node
+        larger.m_size = unknown_size;
+        m_size = unknown_size;
+    }
+    return larger;
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename Q>
+splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics> splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::split(const Q& key) {
+    return split_off<false>(key);
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename Q>
+splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics> splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::extract_range(const Q& lo, const Q& hi) {
+    splay_tree middle = split_off<false>(lo);
+    splay_tree upper = middle.template split_off<true>(hi);
+    join(upper);
+    return middle;
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+void splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::join(splay_tree& other) {
+    if (&other == this || other.m_root == nullptr) {
+        return;
+    }
+    if (m_root == nullptr) {
+        m_root = other.m_root;
+        m_size = other.m_size;
+        m_arena = other.m_arena;
+        m_own_arena = other.m_own_arena;
+        other.m_root = nullptr;
+        other.m_size = 0;
+        return;
+    }
+    if (m_arena != other.m_arena) {
+        throw std::invalid_argument("Trees do not share an arena!");
+    }
+    // Bring this tree's maximum and other's minimum up, so the maximum has
+    // an empty right subtree to hang other on
+    if constexpr (Splay::top_down) {
+        m_root = splay_down(m_root, [](const splay_tree_node*) { return 1; });
+        other.m_root = splay_down(other.m_root, [](const splay_tree_node*) { return -1; });
+    } else {
+        splay(rightmost(m_root));
+        other.splay(leftmost(other.m_root));
+    }
+    if (!(m_root->m_key < other.m_root->m_key)) {
+        throw std::invalid_argument("Trees overlap!");
+    }
+    m_root->m_right = other.m_root;
+    if constexpr (!Splay::top_down) {
+        other.m_root->m_parent = m_root;
+    }
+    update_subtree_size(m_root);
+    if constexpr (OrderStatistics) {
+        m_size = subtree_size(m_root);
+    } else {
+        m_size = m_size == unknown_size || other.m_size == unknown_size ? unknown_size : m_size + other.m_size;
+    }
+    other.m_root = nullptr;
+    other.m_size = 0;
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename Q>
+size_t splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::rank(const Q& key) {
+    static_assert(OrderStatistics, "rank needs a tree keeping order statistics");
+    return count_below<false>(key);
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+K splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::select(size_t k) {
+    static_assert(OrderStatistics, "select needs a tree keeping order statistics");
+    if (k >= size()) {
+        throw std::out_of_range("Rank out of range!");
+    }
+    splay_tree_node* current = m_root;
+    size_t depth = 0;
+    while (true) {
+        size_t leftSize = subtree_size(current->m_left);
+        if (k < leftSize) {
+            current = current->m_left;
+        } else if (k > leftSize) {
+            k -= leftSize + 1;
+            current = current->m_right;
+        } else {
+            break;
+        }
+        depth++;
+    }
+    if constexpr (Splay::top_down) {
+        // Without parent links, splay the node up by its key
+        m_root = splay_down_to(m_root, current->m_key);
     } else {
-        std::shared_ptr<splay_tree_node> current = m_root;
+        restructure(current, depth);
+    }
+    return current->m_key;
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <typename Q>
+size_t splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::count_range(const Q& lo, const Q& hi) {
+    static_assert(OrderStatistics, "count_range needs a tree keeping order statistics");
+    size_t notAbove = count_below<true>(hi);
+    size_t below = count_below<false>(lo);
+    return notAbove > below ? notAbove - below : 0;
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+size_t splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::subtree_size([[maybe_unused]] const splay_tree_node* node) {
+    if constexpr (OrderStatistics) {
+        return node != nullptr ? node->m_subtree_size : 0;
+    } else {
+        return 0;
+    }
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+void splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::update_subtree_size([[maybe_unused]] splay_tree_node* node) {
+    if constexpr (OrderStatistics) {
+        node->m_subtree_size = 1 + subtree_size(node->m_left) + subtree_size(node->m_right);
+    }
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+template <bool Upper, typename Q>
+size_t splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::count_below(const Q& key) {
+    if (m_root == nullptr) {
+        return 0;
+    } else if constexpr (Splay::top_down) {
+        // The splay leaves key, its predecessor or its successor at the root,
+        // so only the root itself may still need counting
+        m_root = splay_down_to(m_root, key);
+        bool counted = Upper ? !(key < m_root->m_key) : key > m_root->m_key;
+        return subtree_size(m_root->m_left) + (counted ? 1 : 0);
+    } else {
+        splay_tree_node* current = m_root;
+        splay_tree_node* last = m_root;
+        size_t depth = 0;
+        size_t lastDepth = 0;
+        size_t count = 0;
         while (current != nullptr) {
-            if (key < current->m_key) {
-                current = current->m_left;    
-            } else if (key > current->m_key) {
-                current = current->m_right;    
+            last = current;
+            lastDepth = depth;
+            if (Upper ? key < current->m_key : !(key > current->m_key)) {
+                current = current->m_left;
             } else {
-                if (current == m_root && current->m_left == nullptr && current->m_right == nullptr) {
-                    m_root = nullptr;
-                    m_size--;
-                    return std::move(current->m_value);
-                } 
-                if (current != m_root) {
-                    splay(current);
-                }
-                current = m_root;
-                if (current->m_right == nullptr) {
-                    m_root = current->m_left;
-                    current->m_left->m_parent.reset();
-                    m_size--;
-                    return std::move(current->m_value);
-                } else if (current->m_left == nullptr) {
-                    m_root = current->m_right;
-                    current->m_right->m_parent.reset();
-                    m_size--;
-                    return std::move(current->m_value);
-                } else {
-                    std::shared_ptr<splay_tree_node> successor = current->m_right;
-                    while (successor->m_left != nullptr) {
-                        successor = successor->m_left;
-                    }
-                    if (successor == current->m_right) {
-                        successor->m_left = current->m_left;
-                        current->m_left->m_parent = successor;
-                        successor->m_parent.reset();
-                        m_root = successor;
-                        m_size--;
-                        return std::move(current->m_value);
-                    }
-                    std::shared_ptr<splay_tree_node> successorParent = successor->m_parent.lock();
-                    if (successor->m_right != nullptr) {
-                        successor->m_right->m_parent = successorParent;
-                        successorParent->m_left = successor->m_right;   
-                    } else {
-                        successorParent->m_left = nullptr;    
-                    }
-                    successor->m_left = current->m_left;
-                    successor->m_right = current->m_right;
-                    current->m_left->m_parent = successor;
-                    current->m_right->m_parent = successor;
-                    successor->m_parent.reset();
-                    m_root = successor;
-                    m_size--;
-                    return std::move(current->m_value);
-                }
-            }  
+                count += subtree_size(current->m_left) + 1;
+                current = current->m_right;
+            }
+            depth++;
         }
-        throw nonexistent_key();
+        restructure(last, lastDepth);
+        return count;
     }
 }
 
-template <typename K, typename V>
-K splay_tree<K,V>::minimum_key() {
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+K splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::minimum_key() {
     if (m_root == nullptr) {
         throw empty_tree();
+    } else if constexpr (Splay::top_down) {
+        m_root = splay_down(m_root, [](const splay_tree_node*) { return -1; });
+        return m_root->m_key;
     } else {
-        std::shared_ptr<splay_tree_node> current = m_root;
+        splay_tree_node* current = m_root;
+        size_t depth = 0;
         while (current->m_left != nullptr) {
-            current = current->m_left;    
+            current = current->m_left;
+            depth++;
         }
-        splay(current);
-        return current->m_key;
+        K key = current->m_key;
+        restructure(current, depth);
+        return key;
     }
 }
 
-template <typename K, typename V>
-K splay_tree<K,V>::maximum_key() {
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+K splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::maximum_key() {
     if (m_root == nullptr) {
         throw empty_tree();
+    } else if constexpr (Splay::top_down) {
+        m_root = splay_down(m_root, [](const splay_tree_node*) { return 1; });
+        return m_root->m_key;
     } else {
-        std::shared_ptr<splay_tree_node> current = m_root;
+        splay_tree_node* current = m_root;
+        size_t depth = 0;
         while (current->m_right != nullptr) {
-            current = current->m_right;    
+            current = current->m_right;
+            depth++;
         }
-        splay(current);
-        return current->m_key;
+        K key = current->m_key;
+        restructure(current, depth);
+        return key;
     }
 }
 
-template <typename K, typename V>
-bool splay_tree<K,V>::empty() const {
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+bool splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::empty() const {
 	if (m_root == nullptr) {
-        return true;    
+        return true;
     }
     return false;
 }
 
-template <typename K, typename V>
-size_t splay_tree<K,V>::size() const {
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+size_t splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::size() const {
+	if (m_size == unknown_size) {
+        return count_nodes();
+    }
 	return m_size;
 }
 
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+void splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::clear() {
+    destroy_nodes();
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+void splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::adjust_size(std::ptrdiff_t delta) {
+    if (m_size == unknown_size) {
+        m_size = count_nodes();
+    } else {
+        m_size += static_cast<size_t>(delta);
+    }
+}
+
+template <typename K, typename V, typename Splay, bool CacheHash, bool InlineValue, bool OrderStatistics>
+size_t splay_tree<K,V,Splay,CacheHash,InlineValue,OrderStatistics>::count_nodes() const {
+    size_t count = 0;
+    std::vector<const splay_tree_node*> pending;
+    const splay_tree_node* node = m_root;
+    while (node != nullptr || !pending.empty()) {
+        if (node == nullptr) {
+            node = pending.back();
+            pending.pop_back();
+        }
+        // Walk down left children, leaving right ones for later
+        count++;
+        if (node->m_right != nullptr) {
+            pending.push_back(node->m_right);
+        }
+        node = node->m_left;
+    }
+    return count;
+}
+
+// splay_tree whose nodes hold values inline, for small values such as numbers
+template <typename K, typename V, typename Splay = bottom_up_splay>
+using inline_splay_tree = splay_tree<K, V, Splay, false, true>;
+
+// splay_tree keeping order statistics, for rank, select and count_range
+template <typename K, typename V, typename Splay = bottom_up_splay>
+using order_statistic_splay_tree = splay_tree<K, V, Splay, false, false, true>;
+
 }
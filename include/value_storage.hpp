@@ -0,0 +1,52 @@
+#pragma once
+#include <memory>
+#include <stdexcept>
+#include <utility>
+namespace cs251 {
+
+// How container nodes hold their values. By default a value lives behind
+// the std::unique_ptr the API hands over, so peek returns that pointer and
+// extract gives it back; with InlineValue the node holds V itself, saving
+// an allocation per entry and a dependent load per lookup, peek returns a
+// reference to V and extract returns V by value
+// Inline values must be default constructible, like keys, since empty
+// slots and fresh nodes hold a default value
+template <typename V, bool InlineValue>
+struct value_storage {
+	// What a node holds and extract returns
+	using holder = std::unique_ptr<V>;
+	// What peek returns
+	using reference = const std::unique_ptr<V>&;
+	using const_reference = const std::unique_ptr<V>&;
+
+	// Turn a value handed over by insert into a holder
+	static holder from_pointer(std::unique_ptr<V> value) { return value; }
+	// Construct a value from args
+	template <typename... Args>
+	static holder make(Args&&... args) { return std::make_unique<V>(std::forward<Args>(args)...); }
+	// Return the value of a holder, or nullptr if it holds none
+	static V* get(holder& value) { return value.get(); }
+	// Return the value a peek result refers to, which must not be null
+	static const V& deref(const_reference value) { return *value; }
+};
+
+template <typename V>
+struct value_storage<V, true> {
+	using holder = V;
+	using reference = V&;
+	using const_reference = const V&;
+
+	// Throw std::invalid_argument if value is null, as there is nothing to store
+	static holder from_pointer(std::unique_ptr<V> value) {
+		if (value == nullptr) {
+			throw std::invalid_argument("Null value!");
+		}
+		return std::move(*value);
+	}
+	template <typename... Args>
+	static holder make(Args&&... args) { return V(std::forward<Args>(args)...); }
+	static V* get(holder& value) { return &value; }
+	static const V& deref(const_reference value) { return value; }
+};
+
+}
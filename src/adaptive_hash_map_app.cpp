@@ -2,6 +2,7 @@
 #include <sstream>
 #include <iomanip>
 #include <memory>
+#include <vector>
 #include "app.hpp"
 #include "adaptive_hash_map.hpp"
 using namespace cs251;
@@ -13,9 +14,17 @@ using namespace cs251;
 */
 template <typename K, typename V> void run_test();
 template <typename K, typename V> void print_table(const adaptive_hash_map<K,V>& hm);
+template <typename Node>
+void print_tree(const Node* node, std::string prefix = "", std::string child_prefix = "");
+
+// Copy of an inline bucket entry, linked into a tree only for display
 template <typename K, typename V>
-void print_tree(std::shared_ptr<typename splay_tree<K,V>::splay_tree_node> node,
-		std::string prefix = "", std::string child_prefix = "");
+struct display_node {
+	K m_key;
+	const V* m_value;
+	display_node* m_left = nullptr;
+	display_node* m_right = nullptr;
+};
 
 int main() {
 	try {
@@ -147,28 +156,60 @@ template <typename K, typename V> void print_table(const adaptive_hash_map<K,V>&
 		std::string prefix = ss.str();
 		std::string child_prefix = "     ";
 
-		const auto& tree = data[i];
-		if (tree.empty()) {
+		const auto& bucket = data[i];
+		if (bucket.empty()) {
 			std::cout << prefix << "[empty]" << std::endl;
 			continue;
 		}
+		if (bucket.promoted()) {
+			print_tree(bucket.get_root(), prefix, child_prefix);
+			continue;
+		}
 
-		print_tree<K,V>(tree.get_root(), prefix, child_prefix);
+		// Inline entries form no tree, so show copies of them linked into
+		// one, each inserted below the ones that arrived before it
+		std::vector<display_node<K,V>> nodes;
+		nodes.reserve(bucket.size());
+		bucket.for_each_inline([&nodes](const auto& entry) {
+			nodes.push_back({entry.m_key, &*entry.m_value});
+			display_node<K,V>* node = &nodes.back();
+			for (display_node<K,V>* parent = &nodes.front(); parent != node; ) {
+				display_node<K,V>*& child = node->m_key < parent->m_key ? parent->m_left : parent->m_right;
+				if (child == nullptr) {
+					child = node;
+				}
+				parent = child;
+			}
+		});
+		print_tree(&nodes.front(), prefix, child_prefix);
 	}
 }
 
-template <typename K, typename V>
-void print_tree(std::shared_ptr<typename splay_tree<K,V>::splay_tree_node> node,
-		std::string prefix, std::string child_prefix) {
-	if (!node) return;
-
-	std::cout << prefix << node->m_key << " -> " << *node->m_value << std::endl;
-	if (node->m_left && !node->m_right) {
-		print_tree<K,V>(node->m_left, child_prefix + "└L: ", child_prefix + " ");
-	} else if (node->m_left && node->m_right) {
-		print_tree<K,V>(node->m_left, child_prefix + "├L: ", child_prefix + "│");
-	}
-	if (node->m_right) {
-		print_tree<K,V>(node->m_right, child_prefix + "└R: ", child_prefix + " ");
+template <typename Node>
+void print_tree(const Node* node, std::string prefix, std::string child_prefix) {
+	// Print in preorder from an explicit stack rather than recursing, so
+	// degenerate trees of any depth print without overflowing the call stack
+	struct pending {
+		const Node* node;
+		std::string prefix;
+		std::string child_prefix;
+	};
+	std::vector<pending> stack;
+	if (node) stack.push_back({node, prefix, child_prefix});
+	while (!stack.empty()) {
+		pending top = std::move(stack.back());
+		stack.pop_back();
+		node = top.node;
+
+		std::cout << top.prefix << node->m_key << " -> " << *node->m_value << std::endl;
+		// Push the right child first so the left one is printed first
+		if (node->m_right) {
+			stack.push_back({node->m_right, top.child_prefix + "└R: ", top.child_prefix + " "});
+		}
+		if (node->m_left && !node->m_right) {
+			stack.push_back({node->m_left, top.child_prefix + "└L: ", top.child_prefix + " "});
+		} else if (node->m_left && node->m_right) {
+			stack.push_back({node->m_left, top.child_prefix + "├L: ", top.child_prefix + "│"});
+		}
 	}
 }
@@ -2,6 +2,7 @@
 #include <sstream>
 #include <iomanip>
 #include <memory>
+#include <vector>
 #include "app.hpp"
 #include "splay_tree.hpp"
 using namespace cs251;
@@ -13,7 +14,7 @@ using namespace cs251;
 */
 template <typename K, typename V> void run_test();
 template <typename K, typename V>
-void print_tree(std::shared_ptr<typename splay_tree<K,V>::splay_tree_node> node,
+void print_tree(const typename splay_tree<K,V>::splay_tree_node* node,
 		std::string prefix = "", std::string child_prefix = "");
 
 int main() {
@@ -131,17 +132,31 @@ template <typename K, typename V> void run_test() {
 }
 
 template <typename K, typename V>
-void print_tree(std::shared_ptr<typename splay_tree<K,V>::splay_tree_node> node,
+void print_tree(const typename splay_tree<K,V>::splay_tree_node* node,
 		std::string prefix, std::string child_prefix) {
-	if (!node) return;
-
-	std::cout << prefix << node->m_key << " -> " << *node->m_value << std::endl;
-	if (node->m_left && !node->m_right) {
-		print_tree<K,V>(node->m_left, child_prefix + "└L: ", child_prefix + " ");
-	} else if (node->m_left && node->m_right) {
-		print_tree<K,V>(node->m_left, child_prefix + "├L: ", child_prefix + "│");
-	}
-	if (node->m_right) {
-		print_tree<K,V>(node->m_right, child_prefix + "└R: ", child_prefix + " ");
+	// Print in preorder from an explicit stack rather than recursing, so
+	// degenerate trees of any depth print without overflowing the call stack
+	struct pending {
+		const typename splay_tree<K,V>::splay_tree_node* node;
+		std::string prefix;
+		std::string child_prefix;
+	};
+	std::vector<pending> stack;
+	if (node) stack.push_back({node, prefix, child_prefix});
+	while (!stack.empty()) {
+		pending top = std::move(stack.back());
+		stack.pop_back();
+		node = top.node;
+
+		std::cout << top.prefix << node->m_key << " -> " << *node->m_value << std::endl;
+		// Push the right child first so the left one is printed first
+		if (node->m_right) {
+			stack.push_back({node->m_right, top.child_prefix + "└R: ", top.child_prefix + " "});
+		}
+		if (node->m_left && !node->m_right) {
+			stack.push_back({node->m_left, top.child_prefix + "└L: ", top.child_prefix + " "});
+		} else if (node->m_left && node->m_right) {
+			stack.push_back({node->m_left, top.child_prefix + "├L: ", top.child_prefix + "│"});
+		}
 	}
 }
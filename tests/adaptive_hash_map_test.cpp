@@ -0,0 +1,468 @@
+#include <cassert>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "app.hpp"
+#include "adaptive_hash_map.hpp"
+using namespace cs251;
+
+/*
+* Regression tests for adaptive_hash_map insertion failures and incremental
+* rehashing.
+* Build and run with `make -C tests check`; LeakSanitizer reports any node
+* or value a failed insert leaves behind.
+*/
+
+// Splays like bottom_up_splay, but throws std::bad_alloc while failing is
+// set, as a bucket promoting into a tree it cannot allocate would
+struct failing_splay {
+	static constexpr bool top_down = false;
+	splay_action on_access(size_t) {
+		if (failing) {
+			throw std::bad_alloc();
+		}
+		return splay_action::splay;
+	}
+	static inline bool failing = false;
+};
+
+// Every key in the same bucket, however many buckets there are
+struct constant_hash {
+	size_t operator()(long) const { return 0; }
+};
+
+// A bucket that fails to build its tree keeps its inline entries, and the
+// node of the failed insert is destroyed along with its value
+static void test_failed_promotion() {
+	using map_type = adaptive_hash_map<long,long,failing_splay,constant_hash>;
+	using bucket_type = hybrid_bucket<splay_tree<long,long,failing_splay,cache_hash_codes<long>::value,false>>;
+	map_type map;
+	const long inlineCount = static_cast<long>(bucket_type::small_bucket_size);
+	for (long key = 0; key < inlineCount; key++) {
+		map.insert(key, std::make_unique<long>(key * 10));
+	}
+	std::unique_ptr<long> value = std::make_unique<long>(inlineCount * 10);
+	bool threw = false;
+	failing_splay::failing = true;
+	try {
+		map.insert(inlineCount, std::move(value));
+	} catch (const std::bad_alloc&) {
+		threw = true;
+	}
+	failing_splay::failing = false;
+	assert(threw);
+	assert(map.size() == static_cast<size_t>(inlineCount));
+	for (long key = 0; key < inlineCount; key++) {
+		assert(*map.peek(key) == key * 10);
+	}
+	// The same insert succeeds once memory is back, promoting the bucket
+	for (long key = inlineCount; key < 4 * inlineCount; key++) {
+		map.insert(key, std::make_unique<long>(key * 10));
+	}
+	assert(map.size() == static_cast<size_t>(4 * inlineCount));
+	for (long key = 0; key < 4 * inlineCount; key++) {
+		assert(*map.peek(key) == key * 10);
+	}
+}
+
+// Return whether key is in map
+template <typename Map, typename Key>
+static bool contains(Map& map, const Key& key) {
+	try {
+		map.peek(key);
+		return true;
+	} catch (const nonexistent_key&) {
+		return false;
+	}
+}
+
+// A key whose copy throws std::bad_alloc while failing is set, counting
+// the keys alive so a node left behind shows
+struct fragile_key {
+	fragile_key() { live++; }
+	fragile_key(long value) : m_value(value) { live++; }
+	fragile_key(const fragile_key& other) : m_value(other.m_value) { live++; }
+	~fragile_key() { live--; }
+	fragile_key& operator=(const fragile_key& other) {
+		if (failing) {
+			throw std::bad_alloc();
+		}
+		m_value = other.m_value;
+		return *this;
+	}
+	bool operator<(const fragile_key& other) const { return m_value < other.m_value; }
+	bool operator>(const fragile_key& other) const { return m_value > other.m_value; }
+	long m_value = 0;
+	static inline bool failing = false;
+	static inline long live = 0;
+};
+
+struct fragile_key_hash {
+	size_t operator()(const fragile_key& key) const { return mixed_hash<long>{}(key.m_value); }
+};
+
+// An insert whose key fails to copy destroys the node it took from the arena
+static void test_failed_key_copy() {
+	{
+		adaptive_hash_map<fragile_key,long,bottom_up_splay,fragile_key_hash> map;
+		map.insert(1, std::make_unique<long>(10));
+		bool threw = false;
+		fragile_key::failing = true;
+		try {
+			map.insert(2, std::make_unique<long>(20));
+		} catch (const std::bad_alloc&) {
+			threw = true;
+		}
+		fragile_key::failing = false;
+		assert(threw);
+		assert(map.size() == 1 && *map.peek(1) == 10);
+		map.insert(2, std::make_unique<long>(20));
+		assert(map.size() == 2 && *map.peek(2) == 20);
+	}
+	assert(fragile_key::live == 0);
+}
+
+// Keys go to bucket key % 2, so even and odd keys land in two buckets
+struct parity_hash {
+	size_t operator()(long key) const { return static_cast<size_t>(key) % 2; }
+};
+
+// A bulk insert whose last bucket fails to build its tree takes the keys
+// it already linked back out, and hands every value back to the caller
+static void test_failed_bulk_promotion() {
+	using map_type = adaptive_hash_map<long,long,failing_splay,parity_hash>;
+	map_type map;
+	map.insert(1, std::make_unique<long>(10));
+	map.insert(3, std::make_unique<long>(30));
+	// Key 0 goes inline into the even bucket first, then the odd bucket
+	// outgrows its inline entries and fails to promote
+	std::vector<std::pair<long, std::unique_ptr<long>>> pairs;
+	for (long key : {0L, 5L, 7L, 9L, 11L}) {
+		pairs.emplace_back(key, std::make_unique<long>(key * 10));
+	}
+	bool threw = false;
+	failing_splay::failing = true;
+	try {
+		map.insert_bulk(pairs.begin(), pairs.end());
+	} catch (const std::bad_alloc&) {
+		threw = true;
+	}
+	failing_splay::failing = false;
+	assert(threw);
+	assert(map.size() == 2);
+	assert(*map.peek(1) == 10 && *map.peek(3) == 30);
+	for (const auto& pair : pairs) {
+		assert(pair.second != nullptr && *pair.second == pair.first * 10);
+		assert(!contains(map, pair.first));
+	}
+	// The values moved back can be inserted again
+	map.insert_bulk(pairs.begin(), pairs.end());
+	assert(map.size() == 7);
+	for (long key : {0L, 1L, 3L, 5L, 7L, 9L, 11L}) {
+		assert(*map.peek(key) == key * 10);
+	}
+}
+
+// Check that map holds exactly the keys of model, each with its value,
+// through the const peek, which never migrates
+template <typename Map>
+static void check_contents(const Map& map, const std::map<int,int>& model, int keyLimit) {
+	assert(map.size() == model.size());
+	assert(map.empty() == model.empty());
+	for (int key = 0; key < keyLimit; key++) {
+		auto it = model.find(key);
+		try {
+			int value = *map.peek(key);
+			assert(it != model.end() && value == it->second);
+		} catch (const nonexistent_key&) {
+			assert(it == model.end());
+		}
+	}
+}
+
+// Run insert, peek, extract and const peek in turn while an incremental
+// rehash drains, checking the contents after every operation, until the
+// migration completes
+template <typename Map>
+static void step_migration(Map& map, std::map<int,int>& model, int& nextKey) {
+	assert(map.rehashing());
+	float progress = map.rehash_progress();
+	size_t operations = 0;
+	while (map.rehashing()) {
+		assert(progress >= 0.0f && progress < 1.0f);
+		int existing = model.begin()->first;
+		switch (operations % 4) {
+		case 0:
+			map.insert(nextKey, std::make_unique<int>(nextKey * 3));
+			model[nextKey] = nextKey * 3;
+			nextKey++;
+			break;
+		case 1:
+			assert(*map.peek(existing) == model[existing]);
+			break;
+		case 2:
+			assert(*map.extract(existing) == model[existing]);
+			model.erase(existing);
+			break;
+		default:
+			assert(*static_cast<const Map&>(map).peek(existing) == model[existing]);
+			// The const peek must not have moved the migration on
+			assert(map.rehash_progress() == progress);
+			break;
+		}
+		operations++;
+		check_contents(map, model, nextKey);
+		if (map.rehashing()) {
+			assert(map.rehash_progress() >= progress);
+			progress = map.rehash_progress();
+		}
+	}
+	assert(map.rehash_progress() == 1.0f);
+	// Migrating one unit per operation takes several operations
+	assert(operations > 1);
+}
+
+// An incremental rehash migrating step units per operation keeps every key
+// reachable and the size exact at each point of the migration
+static void test_incremental_rehash(size_t step) {
+	adaptive_hash_map<int,int> map;
+	map.incremental_rehash(step);
+	assert(map.incremental_rehash() == step);
+	assert(!map.rehashing() && map.rehash_progress() == 1.0f);
+	std::map<int,int> model;
+	int nextKey = 0;
+	// Grow until some doubling starts migrating, past the first few tiny ones
+	while (model.size() < 64 || !map.rehashing()) {
+		map.insert(nextKey, std::make_unique<int>(nextKey * 3));
+		model[nextKey] = nextKey * 3;
+		nextKey++;
+		check_contents(map, model, nextKey);
+	}
+	step_migration(map, model, nextKey);
+	// Switching back to whole rehashes finishes a running one at once
+	while (!map.rehashing()) {
+		map.insert(nextKey, std::make_unique<int>(nextKey * 3));
+		model[nextKey] = nextKey * 3;
+		nextKey++;
+	}
+	map.incremental_rehash(0);
+	assert(!map.rehashing());
+	check_contents(map, model, nextKey);
+}
+
+// Batched peek, insert and extract agree with single operations, and a
+// batch that fails stops at the bad key, as documented
+static void test_batches() {
+	adaptive_hash_map<int,int> map;
+	std::vector<std::pair<int, std::unique_ptr<int>>> pairs;
+	for (int key = 0; key < 100; key++) {
+		pairs.emplace_back(key, std::make_unique<int>(key * 5));
+	}
+	map.insert_batch(pairs.begin(), pairs.end());
+	assert(map.size() == 100);
+	std::vector<int> keys(120);
+	for (int key = 0; key < 120; key++) {
+		keys[static_cast<size_t>(key)] = key;
+	}
+	std::vector<int*> found;
+	map.peek_batch(keys.begin(), keys.end(), std::back_inserter(found));
+	assert(found.size() == keys.size());
+	for (int key = 0; key < 120; key++) {
+		int* value = found[static_cast<size_t>(key)];
+		assert(key < 100 ? value != nullptr && *value == key * 5 : value == nullptr);
+	}
+
+	// Keys 100 to 109 go in, then 50 already exists
+	std::vector<std::pair<int, std::unique_ptr<int>>> clashing;
+	for (int key : {100, 101, 102, 103, 104, 105, 106, 107, 108, 109, 50, 110, 111}) {
+		clashing.emplace_back(key, std::make_unique<int>(key * 7));
+	}
+	bool threw = false;
+	try {
+		map.insert_batch(clashing.begin(), clashing.end());
+	} catch (const duplicate_key&) {
+		threw = true;
+	}
+	assert(threw && map.size() == 110);
+	for (size_t i = 0; i < clashing.size(); i++) {
+		int key = clashing[i].first;
+		if (i < 10) {
+			assert(clashing[i].second == nullptr && *map.peek(key) == key * 7);
+		} else {
+			// The duplicate and everything after it stay with the caller
+			assert(clashing[i].second != nullptr && *clashing[i].second == key * 7);
+		}
+	}
+	assert(*map.peek(50) == 250);
+	assert(!contains(map, 110) && !contains(map, 111));
+
+	// Keys 0 to 9 come out, then 500 is missing
+	std::vector<int> extracting = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 500, 10, 11};
+	std::vector<std::unique_ptr<int>> values;
+	threw = false;
+	try {
+		map.extract_batch(extracting.begin(), extracting.end(), std::back_inserter(values));
+	} catch (const nonexistent_key&) {
+		threw = true;
+	}
+	assert(threw && map.size() == 100 && values.size() == 10);
+	for (int key = 0; key < 10; key++) {
+		assert(*values[static_cast<size_t>(key)] == key * 5 && !contains(map, key));
+	}
+	assert(*map.peek(10) == 50 && *map.peek(11) == 55);
+}
+
+// Lookups by name_view and std::string_view find what lookups by the keys
+// themselves find, through peek, the const peek and extract
+static void test_transparent_lookup() {
+	adaptive_hash_map<name,int> names;
+	const char* firsts[] = {"Ada", "Alan", "Grace", "Edsger", "Barbara"};
+	const char* lasts[] = {"Lovelace", "Turing", "Hopper", "Dijkstra", "Liskov-with-a-long-last-name"};
+	for (int i = 0; i < 5; i++) {
+		for (int j = 0; j < 5; j++) {
+			names.insert(name(firsts[i], lasts[j]), std::make_unique<int>(i * 5 + j));
+		}
+	}
+	const adaptive_hash_map<name,int>& constNames = names;
+	for (int i = 0; i < 5; i++) {
+		for (int j = 0; j < 5; j++) {
+			name_view view(firsts[i], lasts[j]);
+			assert(*names.peek(view) == i * 5 + j);
+			assert(*constNames.peek(view) == i * 5 + j);
+		}
+	}
+	// First and last swapped is another name
+	bool threw = false;
+	try {
+		names.peek(name_view("Lovelace", "Ada"));
+	} catch (const nonexistent_key&) {
+		threw = true;
+	}
+	assert(threw);
+	assert(*names.extract(name_view("Grace", "Hopper")) == 12);
+	assert(names.size() == 24 && !contains(names, name("Grace", "Hopper")));
+
+	adaptive_hash_map<std::string,int> strings;
+	std::string longKey(40, 'k');
+	strings.insert("short", std::make_unique<int>(1));
+	strings.insert(longKey, std::make_unique<int>(2));
+	assert(*strings.peek(std::string_view("short")) == 1);
+	const adaptive_hash_map<std::string,int>& constStrings = strings;
+	assert(*constStrings.peek(std::string_view(longKey)) == 2);
+	assert(*strings.extract(std::string_view(longKey)) == 2 && strings.size() == 1);
+}
+
+// Count every call to the hasher
+struct counting_hash {
+	static size_t calls;
+	size_t operator()(int key) const {
+		calls++;
+		return mixed_hash<int>{}(key);
+	}
+};
+size_t counting_hash::calls = 0;
+
+// With CacheHash, growing and resizing the table move entries without
+// calling the hasher, and every entry stays reachable; without it, every
+// entry is hashed again
+template <bool CacheHash>
+static void test_cached_hash() {
+	adaptive_hash_map<int,int,bottom_up_splay,counting_hash,CacheHash> map;
+	std::map<int,int> model;
+	const int count = 1000;
+	counting_hash::calls = 0;
+	for (int key = 0; key < count; key++) {
+		map.insert(key, std::make_unique<int>(key * 7));
+		model[key] = key * 7;
+	}
+	// One hash per insert, whatever the table grew through meanwhile
+	assert((counting_hash::calls == count) == CacheHash);
+	counting_hash::calls = 0;
+	map.resize(8 * count);
+	assert((counting_hash::calls == 0) == CacheHash);
+	for (int key = 0; key < count; key += 2) {
+		assert(*map.extract(key) == key * 7);
+		model.erase(key);
+	}
+	counting_hash::calls = 0;
+	map.resize(count);
+	assert((counting_hash::calls == 0) == CacheHash);
+	check_contents(map, model, count);
+}
+
+// A value that counts how often it is built from arguments
+struct tracked {
+	static int built;
+	int first = 0;
+	int second = 0;
+	tracked() = default;
+	tracked(int a, int b) : first(a), second(b) { built++; }
+};
+int tracked::built = 0;
+
+// Inline values are built in place by emplace and try_emplace, which builds
+// nothing for a key already present, and are handed back by value
+static void test_inline_values() {
+	inline_adaptive_hash_map<int,tracked> map;
+	tracked::built = 0;
+	tracked& first = map.emplace(1, 10, 11);
+	assert(first.first == 10 && first.second == 11 && tracked::built == 1);
+	bool threw = false;
+	try {
+		map.emplace(1, 20, 21);
+	} catch (const duplicate_key&) {
+		threw = true;
+	}
+	assert(threw && map.size() == 1 && map.peek(1).first == 10);
+	int built = tracked::built;
+	std::pair<tracked*, bool> existing = map.try_emplace(1, 30, 31);
+	assert(!existing.second && existing.first->first == 10 && tracked::built == built);
+	std::pair<tracked*, bool> added = map.try_emplace(2, 40, 41);
+	assert(added.second && added.first->first == 40 && tracked::built == built + 1);
+	// peek refers to the stored value itself
+	map.peek(2).second = 42;
+	assert(map.peek(2).second == 42);
+
+	map.insert(3, std::make_unique<tracked>(50, 51));
+	threw = false;
+	try {
+		map.insert(4, nullptr);
+	} catch (const std::invalid_argument&) {
+		threw = true;
+	}
+	assert(threw && map.size() == 3);
+	// Growing the table keeps the values
+	for (int key = 5; key < 1000; key++) {
+		map.emplace(key, key, -key);
+	}
+	// Nodes never move, so the first reference is still good
+	assert(first.first == 10 && &first == &map.peek(1));
+	for (int key = 5; key < 1000; key++) {
+		assert(map.peek(key).first == key && map.peek(key).second == -key);
+	}
+	tracked value = map.extract(2);
+	assert(value.first == 40 && value.second == 42);
+	assert(map.extract(3).first == 50 && map.size() == 996);
+}
+
+int main() {
+	test_failed_promotion();
+	test_failed_bulk_promotion();
+	test_failed_key_copy();
+	test_incremental_rehash(1);
+	test_incremental_rehash(3);
+	test_batches();
+	test_transparent_lookup();
+	test_cached_hash<true>();
+	test_cached_hash<false>();
+	test_inline_values();
+	std::cout << "adaptive_hash_map_test: ok" << std::endl;
+	return 0;
+}
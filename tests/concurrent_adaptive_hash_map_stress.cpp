@@ -0,0 +1,133 @@
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "concurrent_adaptive_hash_map.hpp"
+#include "seeded_hash.hpp"
+using namespace cs251;
+
+/*
+* Stress test for concurrent_adaptive_hash_map, meant to run under
+* ThreadSanitizer:
+*   make -C tests tsan
+* Readers peek and visit while writers insert and extract keys of their own
+* and keys they all fight over. The map starts with one bucket per stripe, so
+* stripes grow while readers splay or fall back to shared reads. Runs once
+* per configuration: the default map, inline values with top-down splaying,
+* and a seeded hasher.
+*
+* Usage: concurrent_adaptive_hash_map_stress [seconds] [readers] [writers]   (default 3 4 4)
+*/
+
+static long value_of(long key) {
+	return key * 7919 + 13;
+}
+
+// The value extract handed back, by pointer or inline
+static long value_of_holder(const std::unique_ptr<long>& value) { return *value; }
+static long value_of_holder(long value) { return value; }
+
+static constexpr long shared_keys = 64;
+static long private_base(int w) {
+	return shared_keys + static_cast<long>(w) * 1000000;
+}
+
+template <typename Map>
+static void stress(const char* label, double seconds, int readers, int writers) {
+	Map map(1, 8);
+	std::atomic<bool> stop{false};
+	std::vector<std::atomic<long>> sharedBalance(shared_keys);
+
+	std::vector<std::thread> threads;
+	for (int w = 0; w < writers; w++) {
+		threads.emplace_back([&, w] {
+			unsigned seed = static_cast<unsigned>(w) * 2654435761u + 1;
+			auto next = [&seed] { seed = seed * 1103515245u + 12345u; return seed >> 8; };
+			long base = private_base(w);
+			long inserted = 0;
+			long extracted = 0;
+			while (!stop.load(std::memory_order_relaxed)) {
+				unsigned roll = next() % 4;
+				if (roll == 0) {
+					long key = static_cast<long>(next() % shared_keys);
+					try {
+						map.insert(key, std::make_unique<long>(value_of(key)));
+						sharedBalance[key]++;
+					} catch (const duplicate_key&) {
+					}
+				} else if (roll == 1) {
+					long key = static_cast<long>(next() % shared_keys);
+					try {
+						assert(value_of_holder(map.extract(key)) == value_of(key));
+						sharedBalance[key]--;
+					} catch (const nonexistent_key&) {
+					}
+				} else if (roll == 2 || extracted == inserted) {
+					long key = base + inserted++;
+					map.insert(key, std::make_unique<long>(value_of(key)));
+				} else {
+					long key = base + extracted++;
+					assert(value_of_holder(map.extract(key)) == value_of(key));
+				}
+			}
+			for (long key = base + extracted; key < base + inserted; key++) {
+				assert(map.peek(key) == value_of(key));
+			}
+		});
+	}
+	for (int r = 0; r < readers; r++) {
+		threads.emplace_back([&, r] {
+			unsigned seed = static_cast<unsigned>(r) * 40503u + 7;
+			auto next = [&seed] { seed = seed * 1103515245u + 12345u; return seed >> 8; };
+			while (!stop.load(std::memory_order_relaxed)) {
+				long key = next() % 2 == 0
+						? static_cast<long>(next() % shared_keys)
+						: private_base(static_cast<int>(next() % writers)) + static_cast<long>(next() % 1024);
+				try {
+					if (next() % 2 == 0) {
+						assert(map.peek(key) == value_of(key));
+					} else {
+						map.visit(key, [key](const long& value) { assert(value == value_of(key)); });
+					}
+				} catch (const nonexistent_key&) {
+				}
+			}
+		});
+	}
+
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	stop = true;
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	for (long key = 0; key < shared_keys; key++) {
+		long balance = sharedBalance[key].load();
+		assert(balance == 0 || balance == 1);
+		bool present = true;
+		try {
+			map.peek(key);
+		} catch (const nonexistent_key&) {
+			present = false;
+		}
+		assert(present == (balance == 1));
+	}
+	std::printf("concurrent_adaptive_hash_map_stress %s: ok (%zu keys, %zu buckets)\n",
+			label, map.size(), map.bucket_count());
+}
+
+int main(int argc, char** argv) {
+	const double seconds = argc > 1 ? std::atof(argv[1]) : 3.0;
+	const int readers = argc > 2 ? std::atoi(argv[2]) : 4;
+	const int writers = argc > 3 ? std::atoi(argv[3]) : 4;
+	stress<concurrent_adaptive_hash_map<long,long>>("default", seconds / 3, readers, writers);
+	stress<concurrent_adaptive_hash_map<long,long,top_down_splay,mixed_hash<long>,false,true>>(
+			"inline top_down", seconds / 3, readers, writers);
+	stress<concurrent_adaptive_hash_map<long,long,bottom_up_splay,seeded_hash<long>>>(
+			"seeded_hash", seconds / 3, readers, writers);
+	return 0;
+}
@@ -0,0 +1,59 @@
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "hash_map.hpp"
+#include "adaptive_hash_map.hpp"
+#include "concurrent_hash_map.hpp"
+using namespace cs251;
+
+/*
+* Single-threaded checks of concurrent_hash_map over every kind of shard map.
+* Build and run with `make -C tests check`.
+*/
+
+template <typename Map>
+static void test_shard_map() {
+	concurrent_hash_map<int,std::string,Map> map(8);
+	for (int i = 0; i < 1000; i++) {
+		map.insert(i, std::make_unique<std::string>(std::to_string(i)));
+	}
+	assert(map.size() == 1000);
+	for (int i = 0; i < 1000; i++) {
+		assert(map.peek(i) == std::to_string(i));
+		map.visit(i, [&](const std::string& value) { assert(value == std::to_string(i)); });
+	}
+	bool threw = false;
+	try {
+		map.insert(7, std::make_unique<std::string>("again"));
+	} catch (const duplicate_key&) {
+		threw = true;
+	}
+	assert(threw);
+	for (int i = 0; i < 1000; i += 2) {
+		typename concurrent_hash_map<int,std::string,Map>::holder value = map.extract(i);
+		(void)value;
+	}
+	assert(map.size() == 500);
+	threw = false;
+	try {
+		map.peek(0);
+	} catch (const nonexistent_key&) {
+		threw = true;
+	}
+	assert(threw);
+}
+
+int main() {
+	test_shard_map<hash_map<int,std::string>>();
+	test_shard_map<inline_hash_map<int,std::string>>();
+	test_shard_map<adaptive_hash_map<int,std::string>>();
+	test_shard_map<inline_adaptive_hash_map<int,std::string>>();
+	// Inline shards hand back the value itself
+	concurrent_hash_map<int,std::string,inline_hash_map<int,std::string>> map;
+	map.insert(1, std::make_unique<std::string>("one"));
+	std::string value = map.extract(1);
+	assert(value == "one");
+	std::cout << "concurrent_hash_map_test: ok" << std::endl;
+	return 0;
+}
@@ -0,0 +1,409 @@
+#include <cassert>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "app.hpp"
+#include "hash_map.hpp"
+using namespace cs251;
+
+/*
+* Regression tests for hash_map capacity management.
+* Build and run with `make -C tests check`.
+*/
+
+// Extracting after reserve() must keep the reserved capacity
+static void test_reserve_then_extract() {
+	hash_map<int,int> hm;
+	hm.reserve(1 << 20);
+	const size_t reserved = hm.bucket_count();
+	assert(reserved >= (1 << 20));
+	for (int i = 0; i < 10; i++) {
+		hm.insert(i, std::make_unique<int>(i));
+	}
+	for (int i = 0; i < 10; i++) {
+		hm.extract(i);
+		assert(hm.bucket_count() == reserved);
+	}
+	assert(hm.size() == 0);
+	// The table stays usable at its reserved size
+	for (int i = 0; i < 1000; i++) {
+		hm.insert(i, std::make_unique<int>(i));
+	}
+	for (int i = 0; i < 1000; i++) {
+		assert(*hm.peek(i) == i);
+		hm.extract(i);
+	}
+	assert(hm.bucket_count() == reserved);
+}
+
+// Without a reservation, a purge still gives memory back
+static void test_shrink_after_purge() {
+	hash_map<int,int> hm;
+	for (int i = 0; i < 4096; i++) {
+		hm.insert(i, std::make_unique<int>(i));
+	}
+	const size_t grown = hm.bucket_count();
+	for (int i = 0; i < 4096; i++) {
+		hm.extract(i);
+	}
+	assert(hm.bucket_count() < grown);
+}
+
+// A smaller reservation never lowers a larger floor
+static void test_reserve_keeps_larger_floor() {
+	hash_map<int,int> hm;
+	hm.reserve(4096);
+	const size_t reserved = hm.bucket_count();
+	hm.reserve(16);
+	hm.insert(1, std::make_unique<int>(1));
+	hm.extract(1);
+	assert(hm.bucket_count() == reserved);
+}
+
+// Lowering the maximum load factor pulls the minimum down with it
+static void test_max_load_factor_lowers_minimum() {
+	hash_map<int,int> hm;
+	hm.max_load_factor(0.5f);
+	assert(hm.max_load_factor() == 0.5f);
+	assert(hm.min_load_factor() < 0.25f);
+	// A minimum that still fits is kept
+	hm.min_load_factor(0.2f);
+	hm.max_load_factor(0.8f);
+	assert(hm.min_load_factor() == 0.2f);
+	// Never shrinking stays that way
+	hm.min_load_factor(0.0f);
+	hm.max_load_factor(0.1f);
+	assert(hm.min_load_factor() == 0.0f);
+	bool threw = false;
+	try {
+		hm.max_load_factor(1.5f);
+	} catch (const std::invalid_argument&) {
+		threw = true;
+	}
+	assert(threw && hm.max_load_factor() == 0.1f);
+	for (int i = 0; i < 100; i++) {
+		hm.insert(i, std::make_unique<int>(i));
+	}
+	assert(hm.load_factor() <= 0.1f);
+}
+
+// Check that map holds exactly the keys of model, each with its value,
+// through the const peek, which never migrates
+template <typename Map>
+static void check_contents(const Map& map, const std::map<int,int>& model, int keyLimit) {
+	assert(map.size() == model.size());
+	assert(map.empty() == model.empty());
+	for (int key = 0; key < keyLimit; key++) {
+		auto it = model.find(key);
+		try {
+			int value = *map.peek(key);
+			assert(it != model.end() && value == it->second);
+		} catch (const nonexistent_key&) {
+			assert(it == model.end());
+		}
+	}
+}
+
+// Run insert, peek, extract and const peek in turn while an incremental
+// rehash drains, checking the contents after every operation, until the
+// migration completes
+template <typename Map>
+static void step_migration(Map& map, std::map<int,int>& model, int& nextKey) {
+	assert(map.rehashing());
+	float progress = map.rehash_progress();
+	size_t operations = 0;
+	while (map.rehashing()) {
+		assert(progress >= 0.0f && progress < 1.0f);
+		int existing = model.begin()->first;
+		switch (operations % 4) {
+		case 0:
+			map.insert(nextKey, std::make_unique<int>(nextKey * 3));
+			model[nextKey] = nextKey * 3;
+			nextKey++;
+			break;
+		case 1:
+			assert(*map.peek(existing) == model[existing]);
+			break;
+		case 2:
+			assert(*map.extract(existing) == model[existing]);
+			model.erase(existing);
+			break;
+		default:
+			assert(*static_cast<const Map&>(map).peek(existing) == model[existing]);
+			// The const peek must not have moved the migration on
+			assert(map.rehash_progress() == progress);
+			break;
+		}
+		operations++;
+		check_contents(map, model, nextKey);
+		if (map.rehashing()) {
+			assert(map.rehash_progress() >= progress);
+			progress = map.rehash_progress();
+		}
+	}
+	assert(map.rehash_progress() == 1.0f);
+	// Migrating one unit per operation takes several operations
+	assert(operations > 1);
+}
+
+// An incremental rehash migrating step units per operation keeps every key
+// reachable and the size exact at each point of the migration
+static void test_incremental_rehash(size_t step) {
+	hash_map<int,int> map;
+	map.incremental_rehash(step);
+	assert(map.incremental_rehash() == step);
+	assert(!map.rehashing() && map.rehash_progress() == 1.0f);
+	std::map<int,int> model;
+	int nextKey = 0;
+	// Grow until some doubling starts migrating, past the first few tiny ones
+	while (model.size() < 64 || !map.rehashing()) {
+		map.insert(nextKey, std::make_unique<int>(nextKey * 3));
+		model[nextKey] = nextKey * 3;
+		nextKey++;
+		check_contents(map, model, nextKey);
+	}
+	step_migration(map, model, nextKey);
+	// Purge until a halving starts migrating, then drain that too
+	while (!map.rehashing()) {
+		int existing = model.begin()->first;
+		assert(*map.extract(existing) == model[existing]);
+		model.erase(existing);
+		check_contents(map, model, nextKey);
+	}
+	step_migration(map, model, nextKey);
+	// Switching back to whole rehashes finishes a running one at once
+	while (!map.rehashing()) {
+		map.insert(nextKey, std::make_unique<int>(nextKey * 3));
+		model[nextKey] = nextKey * 3;
+		nextKey++;
+	}
+	map.incremental_rehash(0);
+	assert(!map.rehashing());
+	check_contents(map, model, nextKey);
+}
+
+// Return whether key is in map
+template <typename Map, typename Key>
+static bool contains(Map& map, const Key& key) {
+	try {
+		map.peek(key);
+		return true;
+	} catch (const nonexistent_key&) {
+		return false;
+	}
+}
+
+// Batched peek, insert and extract agree with single operations, and a
+// batch that fails stops at the bad key, as documented
+static void test_batches() {
+	hash_map<int,int> map;
+	std::vector<std::pair<int, std::unique_ptr<int>>> pairs;
+	for (int key = 0; key < 100; key++) {
+		pairs.emplace_back(key, std::make_unique<int>(key * 5));
+	}
+	map.insert_batch(pairs.begin(), pairs.end());
+	assert(map.size() == 100);
+	std::vector<int> keys(120);
+	for (int key = 0; key < 120; key++) {
+		keys[static_cast<size_t>(key)] = key;
+	}
+	std::vector<int*> found;
+	map.peek_batch(keys.begin(), keys.end(), std::back_inserter(found));
+	assert(found.size() == keys.size());
+	for (int key = 0; key < 120; key++) {
+		int* value = found[static_cast<size_t>(key)];
+		assert(key < 100 ? value != nullptr && *value == key * 5 : value == nullptr);
+	}
+
+	// Keys 100 to 109 go in, then 50 already exists
+	std::vector<std::pair<int, std::unique_ptr<int>>> clashing;
+	for (int key : {100, 101, 102, 103, 104, 105, 106, 107, 108, 109, 50, 110, 111}) {
+		clashing.emplace_back(key, std::make_unique<int>(key * 7));
+	}
+	bool threw = false;
+	try {
+		map.insert_batch(clashing.begin(), clashing.end());
+	} catch (const duplicate_key&) {
+		threw = true;
+	}
+	assert(threw && map.size() == 110);
+	for (size_t i = 0; i < clashing.size(); i++) {
+		int key = clashing[i].first;
+		if (i < 10) {
+			assert(clashing[i].second == nullptr && *map.peek(key) == key * 7);
+		} else {
+			// The duplicate and everything after it stay with the caller
+			assert(clashing[i].second != nullptr && *clashing[i].second == key * 7);
+		}
+	}
+	assert(*map.peek(50) == 250);
+	assert(!contains(map, 110) && !contains(map, 111));
+
+	// Keys 0 to 9 come out, then 500 is missing
+	std::vector<int> extracting = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 500, 10, 11};
+	std::vector<std::unique_ptr<int>> values;
+	threw = false;
+	try {
+		map.extract_batch(extracting.begin(), extracting.end(), std::back_inserter(values));
+	} catch (const nonexistent_key&) {
+		threw = true;
+	}
+	assert(threw && map.size() == 100 && values.size() == 10);
+	for (int key = 0; key < 10; key++) {
+		assert(*values[static_cast<size_t>(key)] == key * 5 && !contains(map, key));
+	}
+	assert(*map.peek(10) == 50 && *map.peek(11) == 55);
+}
+
+// Lookups by name_view and std::string_view find what lookups by the keys
+// themselves find, through peek, the const peek and extract
+static void test_transparent_lookup() {
+	hash_map<name,int> names;
+	const char* firsts[] = {"Ada", "Alan", "Grace", "Edsger", "Barbara"};
+	const char* lasts[] = {"Lovelace", "Turing", "Hopper", "Dijkstra", "Liskov-with-a-long-last-name"};
+	for (int i = 0; i < 5; i++) {
+		for (int j = 0; j < 5; j++) {
+			names.insert(name(firsts[i], lasts[j]), std::make_unique<int>(i * 5 + j));
+		}
+	}
+	const hash_map<name,int>& constNames = names;
+	for (int i = 0; i < 5; i++) {
+		for (int j = 0; j < 5; j++) {
+			name_view view(firsts[i], lasts[j]);
+			assert(*names.peek(view) == i * 5 + j);
+			assert(*constNames.peek(view) == i * 5 + j);
+		}
+	}
+	// First and last swapped is another name
+	bool threw = false;
+	try {
+		names.peek(name_view("Lovelace", "Ada"));
+	} catch (const nonexistent_key&) {
+		threw = true;
+	}
+	assert(threw);
+	assert(*names.extract(name_view("Grace", "Hopper")) == 12);
+	assert(names.size() == 24 && !contains(names, name("Grace", "Hopper")));
+
+	hash_map<std::string,int> strings;
+	std::string longKey(40, 'k');
+	strings.insert("short", std::make_unique<int>(1));
+	strings.insert(longKey, std::make_unique<int>(2));
+	assert(*strings.peek(std::string_view("short")) == 1);
+	const hash_map<std::string,int>& constStrings = strings;
+	assert(*constStrings.peek(std::string_view(longKey)) == 2);
+	assert(*strings.extract(std::string_view(longKey)) == 2 && strings.size() == 1);
+}
+
+// Count every call to the hasher
+struct counting_hash {
+	static size_t calls;
+	size_t operator()(int key) const {
+		calls++;
+		return mixed_hash<int>{}(key);
+	}
+};
+size_t counting_hash::calls = 0;
+
+// With CacheHash, growing and resizing the table move entries without
+// calling the hasher, and every entry stays reachable; without it, every
+// entry is hashed again
+template <bool CacheHash>
+static void test_cached_hash() {
+	hash_map<int,int,counting_hash,CacheHash> map;
+	std::map<int,int> model;
+	const int count = 1000;
+	counting_hash::calls = 0;
+	for (int key = 0; key < count; key++) {
+		map.insert(key, std::make_unique<int>(key * 7));
+		model[key] = key * 7;
+	}
+	// One hash per insert, whatever the table grew through meanwhile
+	assert((counting_hash::calls == count) == CacheHash);
+	counting_hash::calls = 0;
+	map.resize(8 * count);
+	assert((counting_hash::calls == 0) == CacheHash);
+	for (int key = 0; key < count; key += 2) {
+		assert(*map.extract(key) == key * 7);
+		model.erase(key);
+	}
+	counting_hash::calls = 0;
+	map.resize(count);
+	assert((counting_hash::calls == 0) == CacheHash);
+	check_contents(map, model, count);
+}
+
+// A value that counts how often it is built from arguments
+struct tracked {
+	static int built;
+	int first = 0;
+	int second = 0;
+	tracked() = default;
+	tracked(int a, int b) : first(a), second(b) { built++; }
+};
+int tracked::built = 0;
+
+// Inline values are built in place by emplace and try_emplace, which builds
+// nothing for a key already present, and are handed back by value
+static void test_inline_values() {
+	inline_hash_map<int,tracked> map;
+	tracked::built = 0;
+	tracked& first = map.emplace(1, 10, 11);
+	assert(first.first == 10 && first.second == 11 && tracked::built == 1);
+	bool threw = false;
+	try {
+		map.emplace(1, 20, 21);
+	} catch (const duplicate_key&) {
+		threw = true;
+	}
+	assert(threw && map.size() == 1 && map.peek(1).first == 10);
+	int built = tracked::built;
+	std::pair<tracked*, bool> existing = map.try_emplace(1, 30, 31);
+	assert(!existing.second && existing.first->first == 10 && tracked::built == built);
+	std::pair<tracked*, bool> added = map.try_emplace(2, 40, 41);
+	assert(added.second && added.first->first == 40 && tracked::built == built + 1);
+	// peek refers to the stored value itself
+	map.peek(2).second = 42;
+	assert(map.peek(2).second == 42);
+
+	map.insert(3, std::make_unique<tracked>(50, 51));
+	threw = false;
+	try {
+		map.insert(4, nullptr);
+	} catch (const std::invalid_argument&) {
+		threw = true;
+	}
+	assert(threw && map.size() == 3);
+	// Growing the table keeps the values
+	for (int key = 5; key < 1000; key++) {
+		map.emplace(key, key, -key);
+	}
+	for (int key = 5; key < 1000; key++) {
+		assert(map.peek(key).first == key && map.peek(key).second == -key);
+	}
+	tracked value = map.extract(2);
+	assert(value.first == 40 && value.second == 42);
+	assert(map.extract(3).first == 50 && map.size() == 996);
+}
+
+int main() {
+	test_reserve_then_extract();
+	test_shrink_after_purge();
+	test_reserve_keeps_larger_floor();
+	test_max_load_factor_lowers_minimum();
+	test_incremental_rehash(1);
+	test_incremental_rehash(3);
+	test_batches();
+	test_transparent_lookup();
+	test_cached_hash<true>();
+	test_cached_hash<false>();
+	test_inline_values();
+	std::cout << "hash_map_test: ok" << std::endl;
+	return 0;
+}
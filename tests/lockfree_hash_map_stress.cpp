@@ -0,0 +1,132 @@
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "lockfree_hash_map.hpp"
+using namespace cs251;
+
+/*
+* Stress test for lockfree_hash_map, meant to run under ThreadSanitizer:
+*   make -C tests tsan
+* Readers peek and visit while writers insert and extract, both on keys of
+* their own and on a small set of keys every writer fights over. The table
+* starts with one slot, so growth races everything else.
+*
+* Usage: lockfree_hash_map_stress [seconds] [readers] [writers]   (default 2 4 4)
+*/
+
+// Every value stored for key is value_of(key), so readers can tell a torn
+// or freed value from a live one
+static long value_of(long key) {
+	return key * 7919 + 13;
+}
+
+// Keys every writer inserts and extracts
+static constexpr long shared_keys = 64;
+// First key of the range private to writer w
+static long private_base(int w) {
+	return shared_keys + static_cast<long>(w) * 1000000;
+}
+
+int main(int argc, char** argv) {
+	const double seconds = argc > 1 ? std::atof(argv[1]) : 2.0;
+	const int readers = argc > 2 ? std::atoi(argv[2]) : 4;
+	const int writers = argc > 3 ? std::atoi(argv[3]) : 4;
+
+	lockfree_hash_map<long,long> map;
+	std::atomic<bool> stop{false};
+	// Successful inserts minus successful extracts of each shared key
+	std::vector<std::atomic<long>> sharedBalance(shared_keys);
+	std::atomic<long> hits{0};
+
+	std::vector<std::thread> threads;
+	for (int w = 0; w < writers; w++) {
+		threads.emplace_back([&, w] {
+			unsigned seed = static_cast<unsigned>(w) * 2654435761u + 1;
+			auto next = [&seed] { seed = seed * 1103515245u + 12345u; return seed >> 8; };
+			long base = private_base(w);
+			long inserted = 0;
+			long extracted = 0;
+			while (!stop.load(std::memory_order_relaxed)) {
+				unsigned roll = next() % 4;
+				if (roll == 0) {
+					long key = static_cast<long>(next() % shared_keys);
+					try {
+						map.insert(key, std::make_unique<long>(value_of(key)));
+						sharedBalance[key]++;
+					} catch (const duplicate_key&) {
+					}
+				} else if (roll == 1) {
+					long key = static_cast<long>(next() % shared_keys);
+					try {
+						std::unique_ptr<long> value = map.extract(key);
+						assert(*value == value_of(key));
+						sharedBalance[key]--;
+					} catch (const nonexistent_key&) {
+					}
+				} else if (roll == 2 || extracted == inserted) {
+					long key = base + inserted++;
+					map.insert(key, std::make_unique<long>(value_of(key)));
+				} else {
+					long key = base + extracted++;
+					std::unique_ptr<long> value = map.extract(key);
+					assert(*value == value_of(key));
+				}
+			}
+			// Private keys left behind must all still be there
+			for (long key = base + extracted; key < base + inserted; key++) {
+				assert(map.peek(key) == value_of(key));
+			}
+		});
+	}
+	for (int r = 0; r < readers; r++) {
+		threads.emplace_back([&, r] {
+			unsigned seed = static_cast<unsigned>(r) * 40503u + 7;
+			auto next = [&seed] { seed = seed * 1103515245u + 12345u; return seed >> 8; };
+			long found = 0;
+			while (!stop.load(std::memory_order_relaxed)) {
+				long key = next() % 2 == 0
+						? static_cast<long>(next() % shared_keys)
+						: private_base(static_cast<int>(next() % writers)) + static_cast<long>(next() % 1024);
+				try {
+					if (next() % 2 == 0) {
+						long value = map.peek(key);
+						assert(value == value_of(key));
+					} else {
+						map.visit(key, [key](const long& value) { assert(value == value_of(key)); });
+					}
+					found++;
+				} catch (const nonexistent_key&) {
+				}
+			}
+			hits += found;
+		});
+	}
+
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	stop = true;
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	// A shared key is present exactly when its inserts outnumber its extracts
+	for (long key = 0; key < shared_keys; key++) {
+		long balance = sharedBalance[key].load();
+		assert(balance == 0 || balance == 1);
+		bool present = true;
+		try {
+			map.peek(key);
+		} catch (const nonexistent_key&) {
+			present = false;
+		}
+		assert(present == (balance == 1));
+	}
+	std::printf("lockfree_hash_map_stress: ok (%zu keys, %zu buckets, %ld reader hits)\n",
+			map.size(), map.bucket_count(), hits.load());
+	return 0;
+}
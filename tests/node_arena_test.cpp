@@ -0,0 +1,60 @@
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+#include "node_arena.hpp"
+using namespace cs251;
+
+/*
+* Regression tests for node_arena.
+* Build and run with `make -C tests check`.
+*/
+
+struct throwing_node {
+	explicit throwing_node(bool fail) {
+		if (fail) {
+			throw std::runtime_error("constructor failed");
+		}
+	}
+	long m_payload[4] {};
+};
+
+// A constructor that throws must not leak its slot
+static void test_create_throw_returns_slot() {
+	node_arena<throwing_node> arena;
+	throwing_node* first = arena.create(false);
+	arena.destroy(first);
+	bool threw = false;
+	try {
+		arena.create(true);
+	} catch (const std::runtime_error&) {
+		threw = true;
+	}
+	assert(threw);
+	// The slot taken off the free list by the failed create is handed out again
+	throwing_node* second = arena.create(false);
+	assert(second == first);
+	arena.destroy(second);
+}
+
+// Repeated failures never grow the arena
+static void test_failed_creates_reuse_one_slot() {
+	node_arena<throwing_node> arena;
+	throwing_node* kept = arena.create(false);
+	for (int i = 0; i < 1000; i++) {
+		try {
+			arena.create(true);
+		} catch (const std::runtime_error&) {
+		}
+	}
+	throwing_node* next = arena.create(false);
+	assert(next == kept + 1);
+	arena.destroy(next);
+	arena.destroy(kept);
+}
+
+int main() {
+	test_create_throw_returns_slot();
+	test_failed_creates_reuse_one_slot();
+	std::cout << "node_arena_test: ok" << std::endl;
+	return 0;
+}
@@ -0,0 +1,73 @@
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include "app.hpp"
+using namespace cs251;
+
+/*
+* Tests that name's small_string members still serve code written against
+* the std::string members name used to have.
+* Build and run with `make -C tests check`.
+*/
+
+static size_t takes_string(const std::string& s) {
+	return s.size();
+}
+
+// Every length, inline, full and spilled, keeps its characters and a null
+static void test_lengths() {
+	static_assert(sizeof(small_string) == 24, "small_string must stay 24 bytes");
+	for (size_t length = 0; length <= 40; length++) {
+		std::string expected(length, 'x');
+		for (size_t i = 0; i < length; i++) {
+			expected[i] = static_cast<char>('a' + i % 26);
+		}
+		small_string s(expected);
+		assert(s.size() == length && s.length() == length);
+		assert(std::strlen(s.c_str()) == length);
+		assert(s.c_str() == expected);
+		small_string copy(s);
+		small_string moved(std::move(copy));
+		assert(moved == expected && copy.empty() && copy.c_str()[0] == '\0');
+		small_string assigned;
+		assigned = moved;
+		assert(assigned == expected);
+	}
+}
+
+// The std::string uses of name's members keep compiling and working
+static void test_string_interface() {
+	name n("Ada", "Lovelace");
+	std::string first = n.m_first;
+	assert(first == "Ada");
+	assert(takes_string(n.m_last) == 8);
+	assert(n.m_first + " " + n.m_last == "Ada Lovelace");
+	assert(std::string("Dr. ") + n.m_first == "Dr. Ada");
+	assert(n.m_last + ',' == "Lovelace,");
+	assert(n.m_last.str() == "Lovelace");
+	assert(n.m_last[0] == 'L' && n.m_last.at(1) == 'o' && n.m_last.front() == 'L' && n.m_last.back() == 'e');
+	assert(n.m_last.find("love") == std::string::npos && n.m_last.find("lace") == 4);
+	assert(n.m_last.find('e') == 3 && n.m_last.rfind('e') == 7);
+	assert(n.m_last.substr(0, 4) == "Love");
+	assert(n.m_first.compare("Ada") == 0 && n.m_first.compare("Bob") < 0);
+	assert(n.m_first < n.m_last && n.m_first <= "Ada" && n.m_last >= std::string("Ada"));
+	std::string letters(n.m_first.begin(), n.m_first.end());
+	assert(letters == "Ada");
+	n.m_first = "Augusta";
+	assert(n.m_first == std::string("Augusta"));
+	std::istringstream in("Charles Babbage");
+	in >> n;
+	std::ostringstream out;
+	out << n;
+	assert(out.str() == "Charles Babbage");
+}
+
+int main() {
+	test_lengths();
+	test_string_interface();
+	std::cout << "small_string_test: ok" << std::endl;
+	return 0;
+}
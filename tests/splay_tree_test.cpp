@@ -0,0 +1,490 @@
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <vector>
+#include "splay_tree.hpp"
+using namespace cs251;
+
+/*
+* Tests for splay_tree: sizes through split and join, failed inserts, the
+* restructuring each splay policy promises, ordered iteration and ranges,
+* order statistics, and traversals of degenerate trees.
+* Build and run with `make -C tests check`.
+*/
+
+template <typename Tree>
+static Tree make_tree(int lo, int hi) {
+	Tree tree;
+	for (int key = lo; key < hi; key++) {
+		tree.insert(key, std::make_unique<int>(key));
+	}
+	return tree;
+}
+
+// Sizes after split, join and extract_range are right either way
+template <typename Tree>
+static void test_split_join() {
+	Tree tree = make_tree<Tree>(0, 100);
+	Tree upper = tree.split(40);
+	assert(tree.size() == 40 && upper.size() == 60);
+	Tree middle = upper.extract_range(50, 59);
+	assert(middle.size() == 10 && upper.size() == 50);
+	tree.join(upper);
+	assert(tree.size() == 90);
+	// An insert or extract after the cut keeps counting from the right size
+	tree.insert(55, std::make_unique<int>(55));
+	tree.extract(0);
+	tree.extract(1);
+	assert(tree.size() == 89);
+	middle.extract(50);
+	assert(middle.size() == 9);
+}
+
+// With OrderStatistics, split and join keep the size without a recount
+static void test_exact_with_order_statistics() {
+	using tree_type = splay_tree<int,int,bottom_up_splay,false,false,true>;
+	tree_type tree = make_tree<tree_type>(0, 100);
+	tree_type upper = tree.split(25);
+	assert(tree.size() == 25 && upper.size() == 75);
+	assert(upper.select(upper.size() - 1) == 99);
+	tree.join(upper);
+	assert(tree.size() == 100 && tree.rank(50) == 50);
+}
+
+// A key whose copy throws std::bad_alloc while failing is set, counting
+// the keys alive so a node left behind shows
+struct fragile_key {
+	fragile_key() { live++; }
+	fragile_key(int value) : m_value(value) { live++; }
+	fragile_key(const fragile_key& other) : m_value(other.m_value) { live++; }
+	~fragile_key() { live--; }
+	fragile_key& operator=(const fragile_key& other) {
+		if (failing) {
+			throw std::bad_alloc();
+		}
+		m_value = other.m_value;
+		return *this;
+	}
+	bool operator<(const fragile_key& other) const { return m_value < other.m_value; }
+	bool operator>(const fragile_key& other) const { return m_value > other.m_value; }
+	int m_value = 0;
+	static inline bool failing = false;
+	static inline long live = 0;
+};
+
+// An insert whose key fails to copy destroys the node it took from the arena
+template <typename Splay>
+static void test_failed_key_copy() {
+	{
+		splay_tree<fragile_key,int,Splay> tree;
+		tree.insert(1, std::make_unique<int>(10));
+		bool threw = false;
+		fragile_key::failing = true;
+		try {
+			tree.insert(2, std::make_unique<int>(20));
+		} catch (const std::bad_alloc&) {
+			threw = true;
+		}
+		fragile_key::failing = false;
+		assert(threw);
+		assert(tree.size() == 1 && *tree.peek(1) == 10);
+		tree.insert(2, std::make_unique<int>(20));
+		assert(tree.size() == 2 && *tree.peek(2) == 20);
+	}
+	assert(fragile_key::live == 0);
+}
+
+// Return the depth of key below the root, reading the links without splaying
+template <typename Tree>
+static size_t depth_of(const Tree& tree, int key) {
+	size_t depth = 0;
+	for (const typename Tree::splay_tree_node* node = tree.get_root(); node != nullptr; depth++) {
+		if (key < node->m_key) {
+			node = node->m_left;
+		} else if (key > node->m_key) {
+			node = node->m_right;
+		} else {
+			return depth;
+		}
+	}
+	assert(false);
+	return 0;
+}
+
+// Return the key of the first node found deeper than minDepth, and at most
+// maxDepth deep, or -1 if there is none
+template <typename Tree>
+static int key_at_depth(const Tree& tree, int keyLimit, size_t minDepth, size_t maxDepth) {
+	for (int key = 0; key < keyLimit; key++) {
+		size_t depth = depth_of(tree, key);
+		if (depth > minDepth && depth <= maxDepth) {
+			return key;
+		}
+	}
+	return -1;
+}
+
+// Check that tree holds exactly the keys of model, through the const peek
+template <typename Tree>
+static void check_contents(const Tree& tree, const std::map<int,int>& model, int keyLimit) {
+	assert(tree.size() == model.size());
+	for (int key = 0; key < keyLimit; key++) {
+		auto it = model.find(key);
+		try {
+			int value = *tree.peek(key);
+			assert(it != model.end() && value == it->second);
+		} catch (const nonexistent_key&) {
+			assert(it == model.end());
+		}
+	}
+}
+
+// Random inserts, peeks and extracts keep the contents of the tree right
+template <typename Splay>
+static void test_policy_contents() {
+	splay_tree<int,int,Splay> tree;
+	std::map<int,int> model;
+	const int keyLimit = 200;
+	unsigned seed = 9;
+	for (int i = 0; i < 3000; i++) {
+		seed = seed * 1103515245u + 12345u;
+		int key = static_cast<int>((seed >> 8) % keyLimit);
+		bool present = model.count(key) != 0;
+		switch ((seed >> 20) % 3) {
+		case 0:
+			try {
+				tree.insert(key, std::make_unique<int>(key + i));
+				assert(!present);
+				model[key] = key + i;
+			} catch (const duplicate_key&) {
+				assert(present);
+			}
+			break;
+		case 1:
+			try {
+				int value = *tree.peek(key);
+				assert(present && value == model[key]);
+			} catch (const nonexistent_key&) {
+				assert(!present);
+			}
+			break;
+		default:
+			try {
+				int value = *tree.extract(key);
+				assert(present && value == model[key]);
+				model.erase(key);
+			} catch (const nonexistent_key&) {
+				assert(!present);
+			}
+			break;
+		}
+		if (i % 50 == 0) {
+			check_contents(tree, model, keyLimit);
+		}
+	}
+	check_contents(tree, model, keyLimit);
+}
+
+// Full splaying, bottom-up or top-down, brings every key peeked or
+// inserted to the root
+template <typename Splay>
+static void test_splay_to_root() {
+	splay_tree<int,int,Splay> tree;
+	for (int key = 0; key < 100; key++) {
+		tree.insert((key * 37) % 100, std::make_unique<int>(key));
+		assert(tree.get_root()->m_key == (key * 37) % 100);
+	}
+	for (int key : {0, 99, 50, 13}) {
+		tree.peek(key);
+		assert(tree.get_root()->m_key == key);
+	}
+}
+
+// Semi-splaying moves a deep key most of the way up, roughly halving its depth
+static void test_semi_splay() {
+	splay_tree<int,int,semi_splay> tree;
+	for (int key = 0; key < 100; key++) {
+		tree.insert(key, std::make_unique<int>(key));
+	}
+	int key = key_at_depth(tree, 100, 3, 1000);
+	assert(key >= 0);
+	size_t before = depth_of(tree, key);
+	tree.peek(key);
+	size_t after = depth_of(tree, key);
+	assert(after < before && after <= before / 2 + 1);
+}
+
+// periodic_splay<3> leaves the tree alone for two accesses below the root
+// and splays on the third
+static void test_periodic_splay() {
+	using tree_type = splay_tree<int,int,periodic_splay<3>>;
+	tree_type tree;
+	for (int key = 0; key < 100; key++) {
+		tree.insert((key * 37) % 100, std::make_unique<int>(key));
+	}
+	// The count left over from the inserts is unknown, so splay once to reset it
+	int key = key_at_depth(tree, 100, 0, 1000);
+	for (int access = 0; tree.get_root()->m_key != key; access++) {
+		assert(access < 3);
+		tree.peek(key);
+	}
+	// A deep key, then a child of the root, each take exactly three accesses
+	for (size_t round = 0; round < 2; round++) {
+		int next = round == 0 ? key_at_depth(tree, 100, 1, 1000) : key_at_depth(tree, 100, 0, 1);
+		assert(next >= 0);
+		int root = tree.get_root()->m_key;
+		size_t depth = depth_of(tree, next);
+		tree.peek(next);
+		tree.peek(next);
+		assert(tree.get_root()->m_key == root && depth_of(tree, next) == depth);
+		tree.peek(next);
+		assert(tree.get_root()->m_key == next);
+	}
+}
+
+// depth_splay<4> splays only keys found deeper than 4
+static void test_depth_splay() {
+	using tree_type = splay_tree<int,int,depth_splay<4>>;
+	tree_type tree;
+	for (int key = 0; key < 100; key++) {
+		tree.insert((key * 37) % 100, std::make_unique<int>(key));
+	}
+	int shallow = key_at_depth(tree, 100, 0, 4);
+	assert(shallow >= 0);
+	int root = tree.get_root()->m_key;
+	size_t depth = depth_of(tree, shallow);
+	tree.peek(shallow);
+	assert(tree.get_root()->m_key == root && depth_of(tree, shallow) == depth);
+	int deep = key_at_depth(tree, 100, 4, 1000);
+	if (deep < 0) {
+		// Nothing deep enough yet; ascending keys past the maximum build a path
+		for (int key = 100; deep < 0; key++) {
+			tree.insert(key, std::make_unique<int>(key));
+			deep = key_at_depth(tree, key + 1, 4, 1000);
+		}
+	}
+	tree.peek(deep);
+	assert(tree.get_root()->m_key == deep);
+}
+
+// no_splay never restructures on access, so ascending inserts build a path
+// and peeks leave it as it is
+static void test_no_splay() {
+	splay_tree<int,int,no_splay> tree;
+	for (int key = 0; key < 100; key++) {
+		tree.insert(key, std::make_unique<int>(key));
+	}
+	for (int key : {99, 50, 0}) {
+		tree.peek(key);
+		assert(tree.get_root()->m_key == 0 && depth_of(tree, key) == static_cast<size_t>(key));
+	}
+}
+
+// A tree and a sorted reference holding the keys 0, 3, 6, ... below 300
+template <typename Tree>
+static Tree make_spaced_tree(std::map<int,int>& model) {
+	Tree tree;
+	for (int i = 0; i < 100; i++) {
+		int key = (i * 37) % 100 * 3;
+		tree.insert(key, std::make_unique<int>(key + 1));
+		model[key] = key + 1;
+	}
+	return tree;
+}
+
+// Iterators walk the keys in order both ways, and bounds find the same
+// elements as std::map's, splaying or not
+template <typename Splay>
+static void test_iterators_and_bounds() {
+	using tree_type = splay_tree<int,int,Splay>;
+	std::map<int,int> model;
+	tree_type tree = make_spaced_tree<tree_type>(model);
+	auto expected = model.begin();
+	for (typename tree_type::iterator it = tree.begin(); it != tree.end(); ++it, ++expected) {
+		assert(expected != model.end() && it->m_key == expected->first && *it->m_value == expected->second);
+	}
+	assert(expected == model.end());
+	// Backwards from end(), which decrements to the maximum
+	auto reverse = model.rbegin();
+	for (typename tree_type::iterator it = tree.end(); it != tree.begin(); ++reverse) {
+		--it;
+		assert(it->m_key == reverse->first);
+	}
+	assert(reverse == model.rend());
+	const tree_type& constTree = tree;
+	size_t count = 0;
+	for (typename tree_type::const_iterator it = constTree.begin(); it != constTree.end(); it++) {
+		count++;
+	}
+	assert(count == model.size());
+	for (int key = -2; key <= 302; key++) {
+		auto lower = model.lower_bound(key);
+		auto upper = model.upper_bound(key);
+		typename tree_type::const_iterator constLower = constTree.lower_bound(key);
+		typename tree_type::const_iterator constUpper = constTree.upper_bound(key);
+		assert(lower == model.end() ? constLower == constTree.end() : constLower->m_key == lower->first);
+		assert(upper == model.end() ? constUpper == constTree.end() : constUpper->m_key == upper->first);
+		typename tree_type::iterator treeLower = tree.lower_bound(key);
+		assert(lower == model.end() ? treeLower == tree.end() : treeLower->m_key == lower->first);
+		typename tree_type::iterator treeUpper = tree.upper_bound(key);
+		assert(upper == model.end() ? treeUpper == tree.end() : treeUpper->m_key == upper->first);
+	}
+	// An iterator survives splays elsewhere, and keeps walking in order
+	typename tree_type::iterator it = tree.lower_bound(150);
+	tree.peek(0);
+	tree.peek(297);
+	assert(it->m_key == 150 && (++it)->m_key == 153 && (--it)->m_key == 150);
+}
+
+// range visits the keys between lo and hi inclusive in order and counts
+// them, streaming successors with parent links or splaying each one up
+// without them
+template <typename Splay>
+static void test_range() {
+	using tree_type = splay_tree<int,int,Splay>;
+	std::map<int,int> model;
+	tree_type tree = make_spaced_tree<tree_type>(model);
+	const int bounds[][2] = { {0, 297}, {-10, 400}, {1, 2}, {4, 5}, {3, 3}, {10, 100}, {296, 1000}, {-5, 0}, {50, 40} };
+	for (const auto& bound : bounds) {
+		std::vector<int> visited;
+		size_t count = tree.range(bound[0], bound[1], [&visited](const int& key, const std::unique_ptr<int>& value) {
+			assert(*value == key + 1);
+			visited.push_back(key);
+		});
+		std::vector<int> expected;
+		for (auto it = model.lower_bound(bound[0]); it != model.end() && it->first <= bound[1]; ++it) {
+			expected.push_back(it->first);
+		}
+		assert(count == expected.size() && visited == expected);
+		check_contents(tree, model, 300);
+	}
+}
+
+// rank, select and count_range agree with a sorted reference while random
+// inserts and extracts reshape the tree, and select past the end throws
+template <typename Splay>
+static void test_order_statistics() {
+	splay_tree<int,int,Splay,false,false,true> tree;
+	std::map<int,int> model;
+	unsigned seed = 23;
+	for (int i = 0; i < 600; i++) {
+		seed = seed * 1103515245u + 12345u;
+		int key = static_cast<int>((seed >> 8) % 500);
+		if ((seed >> 20) % 3 != 0) {
+			if (model.count(key) == 0) {
+				tree.insert(key, std::make_unique<int>(key));
+				model[key] = key;
+			}
+		} else if (model.count(key) != 0) {
+			tree.extract(key);
+			model.erase(key);
+		}
+		if (i % 20 != 0) {
+			continue;
+		}
+		std::vector<int> sorted;
+		for (const auto& entry : model) {
+			sorted.push_back(entry.first);
+		}
+		assert(tree.size() == sorted.size());
+		for (size_t k = 0; k < sorted.size(); k++) {
+			assert(tree.select(k) == sorted[k]);
+		}
+		for (int probe = -1; probe <= 501; probe += 7) {
+			size_t below = static_cast<size_t>(std::lower_bound(sorted.begin(), sorted.end(), probe) - sorted.begin());
+			assert(tree.rank(probe) == below);
+			int hi = probe + 40;
+			size_t inRange = static_cast<size_t>(std::upper_bound(sorted.begin(), sorted.end(), hi) - sorted.begin()) - below;
+			assert(tree.count_range(probe, hi) == inRange);
+		}
+		bool threw = false;
+		try {
+			tree.select(sorted.size());
+		} catch (const std::out_of_range&) {
+			threw = true;
+		}
+		assert(threw);
+		check_contents(tree, model, 500);
+	}
+}
+
+// The value a node holds, by pointer or inline
+static int value_of(const std::unique_ptr<int>& value) { return *value; }
+static int value_of(int value) { return value; }
+
+// A tree 100000 nodes deep, built from ascending inserts that leave each
+// new maximum at the root, is walked, cleared and destroyed without
+// recursing; run under AddressSanitizer, a recursive walk overflows
+template <typename Splay, bool InlineValue>
+static void test_degenerate_traversals() {
+	using tree_type = splay_tree<int,int,Splay,false,InlineValue>;
+	const int count = 100000;
+	tree_type tree;
+	for (int round = 0; round < 2; round++) {
+		for (int key = 0; key < count; key++) {
+			tree.emplace(key, key * 2);
+		}
+		assert(depth_of(tree, 0) == static_cast<size_t>(count - 1));
+		int next = 0;
+		tree.for_each([&next](const int& key, typename tree_type::const_reference value) {
+			assert(key == next && value_of(value) == key * 2);
+			next++;
+		});
+		assert(next == count);
+		// Breadth-first from the root, the maximum, down its left path
+		int level = count - 1;
+		tree.for_each_level_order([&level](const int& key, typename tree_type::const_reference) {
+			assert(key == level);
+			level--;
+		});
+		assert(level == -1);
+		if (round == 0) {
+			tree.clear();
+			assert(tree.empty() && tree.size() == 0 && tree.get_root() == nullptr);
+			size_t visited = 0;
+			tree.for_each([&visited](const int&, typename tree_type::const_reference) { visited++; });
+			assert(visited == 0);
+		}
+	}
+	// The second, uncleared tree is left to the destructor
+}
+
+int main() {
+	test_split_join<splay_tree<int,int>>();
+	test_split_join<splay_tree<int,int,top_down_splay>>();
+	test_split_join<splay_tree<int,int,bottom_up_splay,false,false,true>>();
+	test_exact_with_order_statistics();
+	test_failed_key_copy<bottom_up_splay>();
+	test_failed_key_copy<top_down_splay>();
+	test_policy_contents<bottom_up_splay>();
+	test_policy_contents<top_down_splay>();
+	test_policy_contents<semi_splay>();
+	test_policy_contents<periodic_splay<3>>();
+	test_policy_contents<depth_splay<4>>();
+	test_policy_contents<no_splay>();
+	test_splay_to_root<bottom_up_splay>();
+	test_splay_to_root<top_down_splay>();
+	test_semi_splay();
+	test_periodic_splay();
+	test_depth_splay();
+	test_no_splay();
+	test_iterators_and_bounds<bottom_up_splay>();
+	test_iterators_and_bounds<semi_splay>();
+	test_iterators_and_bounds<no_splay>();
+	test_range<bottom_up_splay>();
+	test_range<top_down_splay>();
+	test_range<periodic_splay<3>>();
+	test_order_statistics<bottom_up_splay>();
+	test_order_statistics<top_down_splay>();
+	test_order_statistics<semi_splay>();
+	test_order_statistics<no_splay>();
+	test_degenerate_traversals<bottom_up_splay, false>();
+	test_degenerate_traversals<top_down_splay, false>();
+	test_degenerate_traversals<bottom_up_splay, true>();
+	std::cout << "splay_tree_test: ok" << std::endl;
+	return 0;
+}